@@ -197,9 +197,9 @@ namespace pcie_int {
     }
 
     bool PCIeInterface::PCIeDeviceConfigure() {
-        static DWORD dwAddrSpace;
-        static DWORD dwOffset;
-        static UINT32 u32Data;
+        DWORD dwAddrSpace;
+        DWORD dwOffset;
+        UINT32 u32Data;
         DWORD wr_stat = 0;
 
         dwAddrSpace = 2;
@@ -257,9 +257,9 @@ namespace pcie_int {
         /* imode =0 single word transfer, imode =1 DMA */
         hDev = GetDeviceHandle(dev);
 
-        static DWORD dwAddrSpace;
-        static DWORD dwOffset;
-        static UINT32 u32Data;
+        DWORD dwAddrSpace;
+        DWORD dwOffset;
+        UINT32 u32Data;
         uint32_t nwrite;
         uint32_t iprint = 0;
         uint32_t i = 0;
@@ -373,10 +373,10 @@ namespace pcie_int {
 
         hDev = GetDeviceHandle(dev);
 
-        static DWORD dwAddrSpace;
-        static DWORD dwOffset;
-        static UINT32 u32Data;
-        static UINT64 u64Data;
+        DWORD dwAddrSpace;
+        DWORD dwOffset;
+        UINT32 u32Data;
+        UINT64 u64Data;
         uint32_t nread, i, j, icomp;
         uint32_t iprint = 0;
 
@@ -503,8 +503,9 @@ namespace pcie_int {
     }
 
     bool PCIeInterface::DmaContigBufferLock(uint32_t dev_handle, uint32_t dwDMABufSize, DMABufferHandle *pbuf_rec) {
-        static DWORD dwStatus;
-        static int is;
+        // Not static, the buffers of each card are locked from that card's read thread
+        DWORD dwStatus;
+        int is;
 
         DWORD dwOptions_rec = DMA_FROM_DEVICE | DMA_ALLOW_64BIT_ADDRESS;
 
@@ -7,6 +7,7 @@
 #include "quill/Frontend.h"
 #include "quill/sinks/ConsoleSink.h"
 #include "quill/sinks/FileSink.h"
+#include <algorithm>
 #include <fstream>
 #include <cstdlib>
 
@@ -51,14 +52,15 @@ namespace controller {
 
         LOG_DEBUG(logger_, "Set-Up config dump: {} \n", setup_config_.dump());
 
-        data_handler_ = std::make_unique<data_handler::DataHandler>();
+        // The primary card pair, the others are added when the config is known
+        data_handlers_.push_back(std::make_unique<data_handler::DataHandler>());
         pcie_ctrl_ = std::make_unique<pcie_control::PcieControl>();
         xmit_ctrl_ = std::make_unique<xmit_control::XmitControl>();
         light_fem_ = std::make_unique<light_fem::LightFem>();
         charge_fem_ = std::make_unique<charge_fem::ChargeFem>();
         trigger_ctrl_ = std::make_unique<trig_ctrl::TriggerControl>();
         status_ = std::make_unique<status::Status>();
-        pcie_interface_ = std::make_unique<pcie_int::PCIeInterface>();
+        pcie_interfaces_.push_back(std::make_unique<pcie_int::PCIeInterface>());
         buffers_ = std::make_unique<pcie_int::PcieBuffers>();
 
         LOG_INFO(logger_, "Initialized Controller \n");
@@ -77,9 +79,9 @@ namespace controller {
         charge_fem_.reset();
         trigger_ctrl_.reset();
         status_.reset();
-        data_handler_.reset();
+        data_handlers_.clear();
         pcie_ctrl_.reset();
-        pcie_interface_.reset();
+        pcie_interfaces_.clear();
         buffers_.reset();
 
         LOG_INFO(logger_, "Destructed all hardware \n");
@@ -326,52 +328,70 @@ namespace controller {
 
         print_status_ = config_["controller"]["print_status"].get<bool>();
         status_->SetPrintStatus(print_status_);
-        board_slots_.push_back(config_["crate"]["xmit_slot"].get<int>());
-        board_slots_.push_back(config_["crate"]["charge_fem_slot"].get<int>());
-        board_slots_.push_back(config_["crate"]["charge_fem_slot"].get<int>() + 1);
-        board_slots_.push_back(config_["crate"]["last_charge_slot"].get<int>());
-        board_slots_.push_back(config_["crate"]["light_fem_slot"].get<int>());
-
-        // Connect to the PCIe bus handle
-        const int device_id_0 = config_["controller"]["device_id_0"].get<int>();
-        const int device_id_1 = config_["controller"]["device_id_1"].get<int>();
-        int slot_id_0 = 1, slot_id_1 = 1;
-        if (config_["controller"].contains("slot_id_0") && config_["controller"].contains("slot_id_1")) {
-            if ((config_["controller"]["slot_id_0"].get<int>() > 0) || (config_["controller"]["slot_id_1"].get<int>() > 0)) {
-                slot_id_0 = config_["controller"]["slot_id_0"].get<int>();
-                slot_id_1 = config_["controller"]["slot_id_1"].get<int>();
+
+        // An empty endpoint turns the json metrics off
+        const std::string metrics_endpoint = config_["controller"].value("metrics_endpoint", std::string("tcp://127.0.0.1:1750"));
+        {
+            std::lock_guard<std::mutex> lock(status_mutex_);
+            metrics_socket_.reset();
+            if (!metrics_endpoint.empty()) {
+                try {
+                    metrics_socket_ = std::make_unique<zmq::socket_t>(zmq_context_, zmq::socket_type::push);
+                    metrics_socket_->set(zmq::sockopt::linger, 0);
+                    metrics_socket_->set(zmq::sockopt::sndhwm, 4);
+                    metrics_socket_->connect(metrics_endpoint);
+                } catch (const zmq::error_t &ex) {
+                    LOG_WARNING(logger_, "Failed to connect the metrics socket to {}: {}", metrics_endpoint, ex.what());
+                    metrics_socket_.reset();
+                }
             }
         }
-        LOG_INFO(logger_, "Configuring slot ID 0={} 1={}", slot_id_0, slot_id_1);
-        uint32_t ret = pcie_interface_->InitPCIeDevices(device_id_0, device_id_1, slot_id_0, slot_id_1);
-        if (ret != 0x0) {
-            LOG_ERROR(logger_, "PCIe device initialization failed!");
-            tpc_readout_monitor_.setErrorBitWord(ret);
-            return false;
-        }
+
+        // Connect to the PCIe bus handles
+        if (!InitCardPairs()) return false;
+
+        // The status is read from the primary pair's crate
+        const json primary_config = CardConfig(0);
+        board_slots_.push_back(primary_config["crate"]["xmit_slot"].get<int>());
+        board_slots_.push_back(primary_config["crate"]["charge_fem_slot"].get<int>());
+        board_slots_.push_back(primary_config["crate"]["charge_fem_slot"].get<int>() + 1);
+        board_slots_.push_back(primary_config["crate"]["last_charge_slot"].get<int>());
+        board_slots_.push_back(primary_config["crate"]["light_fem_slot"].get<int>());
 
         LOG_INFO(logger_, "Config dump: {} \n", config_.dump());
 
         LOG_INFO(logger_, "PCIe devices initialized!");
         LOG_INFO(logger_, "Initializing hardware...");
+        // Every pair gets its PCIe link and XMIT set up. The primary always configures the crate and
+        // the trigger, the other pairs their FEMs only if they have a crate of their own.
         uint32_t ret_value = 0x0;
-        ret_value = pcie_ctrl_->Configure(config_, pcie_interface_.get(), *buffers_);
-        if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
-
-        ret_value = xmit_ctrl_->Configure(config_, pcie_interface_.get(), *buffers_);
-        if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
-
-        ret_value = light_fem_->Configure(config_, pcie_interface_.get(), *buffers_);
-        if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
-
-        ret_value = charge_fem_->Configure(config_, pcie_interface_.get(), *buffers_);
-        if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+        for (size_t card = 0; card < pcie_interfaces_.size(); card++) {
+            const json card_config = card == 0 ? primary_config : CardConfig(card);
+            pcie_int::PCIeInterface *pcie_interface = pcie_interfaces_[card].get();
+            LOG_INFO(logger_, "Initializing card pair {}...", card);
+            ret_value = pcie_ctrl_->Configure(card_config, pcie_interface, *buffers_);
+            if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+
+            ret_value = xmit_ctrl_->Configure(card_config, pcie_interface, *buffers_);
+            if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+
+            if (card == 0 || card_pairs_[card].contains("crate")) {
+                ret_value = light_fem_->Configure(card_config, pcie_interface, *buffers_);
+                if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+
+                ret_value = charge_fem_->Configure(card_config, pcie_interface, *buffers_);
+                if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+            }
 
-        ret_value = trigger_ctrl_->Configure(config_, pcie_interface_.get(), *buffers_);
-        if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+            if (card == 0) {
+                ret_value = trigger_ctrl_->Configure(card_config, pcie_interface, *buffers_);
+                if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+            }
 
-        ret_value = data_handler_->Configure(config_);
-        if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+            data_handlers_[card]->SetCard(card);
+            ret_value = data_handlers_[card]->Configure(card_config);
+            if (ret_value != 0x0) { tpc_readout_monitor_.setErrorBitWord(ret_value); }
+        }
 
         LOG_INFO(logger_, "Configured Hardware! \n");
         is_configured_ = true;
@@ -380,11 +400,88 @@ namespace controller {
         return true;
     }
 
+    bool Controller::InitCardPairs() {
+        // Either a list of card pairs or the single pair of the older configs
+        card_pairs_ = config_["controller"].value("card_pairs", json::array());
+        if (card_pairs_.empty()) {
+            json card_pair;
+            card_pair["device_id_0"] = config_["controller"]["device_id_0"].get<int>();
+            card_pair["device_id_1"] = config_["controller"]["device_id_1"].get<int>();
+            card_pair["slot_id_0"] = 1;
+            card_pair["slot_id_1"] = 1;
+            if (config_["controller"].contains("slot_id_0") && config_["controller"].contains("slot_id_1")) {
+                if ((config_["controller"]["slot_id_0"].get<int>() > 0) || (config_["controller"]["slot_id_1"].get<int>() > 0)) {
+                    card_pair["slot_id_0"] = config_["controller"]["slot_id_0"].get<int>();
+                    card_pair["slot_id_1"] = config_["controller"]["slot_id_1"].get<int>();
+                }
+            }
+            card_pairs_.push_back(card_pair);
+        }
+
+        // A reconfigure can change the number of pairs, not allowed while running
+        data_handlers_.resize(std::min(data_handlers_.size(), card_pairs_.size()));
+        pcie_interfaces_.resize(std::min(pcie_interfaces_.size(), card_pairs_.size()));
+        while (pcie_interfaces_.size() < card_pairs_.size()) {
+            pcie_interfaces_.push_back(std::make_unique<pcie_int::PCIeInterface>());
+            data_handlers_.push_back(std::make_unique<data_handler::DataHandler>());
+        }
+        // The pairs writing to the same disk share its write rate
+        storage_share_ = std::make_shared<data_handler::StorageShare>();
+        for (const auto &data_handler : data_handlers_) data_handler->SetStorageShare(storage_share_);
+        // The other pairs pause the triggers through the primary when they throttle
+        for (const auto &data_handler : data_handlers_) data_handler->SetTriggerOwner(data_handlers_.front().get());
+
+        for (size_t card = 0; card < card_pairs_.size(); card++) {
+            const json &card_pair = card_pairs_[card];
+            const int device_id_0 = card_pair["device_id_0"].get<int>();
+            const int device_id_1 = card_pair["device_id_1"].get<int>();
+            const int slot_id_0 = card_pair.value("slot_id_0", 1);
+            const int slot_id_1 = card_pair.value("slot_id_1", 1);
+            LOG_INFO(logger_, "Configuring card pair {} slot ID 0={} 1={}", card, slot_id_0, slot_id_1);
+            uint32_t ret = pcie_interfaces_[card]->InitPCIeDevices(device_id_0, device_id_1, slot_id_0, slot_id_1);
+            if (ret != 0x0) {
+                LOG_ERROR(logger_, "PCIe device initialization failed for card pair {}!", card);
+                tpc_readout_monitor_.setErrorBitWord(ret);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    json Controller::CardConfig(const size_t card) {
+        // A card pair can have its own crate and data handler settings (cores, output directories..)
+        json card_config = config_;
+        const json &card_pair = card_pairs_[card];
+        if (card_pair.contains("crate")) card_config["crate"].update(card_pair["crate"]);
+        if (card_pair.contains("data_handler")) card_config["data_handler"].update(card_pair["data_handler"]);
+        return card_config;
+    }
+
+    void Controller::SampleDataHandlerStatus() {
+        // This essentially samples the metrics that are accumulating in the data handlers, the
+        // other card pairs' are added as card<N>_<metric>
+        status_->SetDataHandlerStatus(data_handlers_.front().get());
+        for (size_t card = 1; card < data_handlers_.size(); card++) {
+            status_->AddDataHandlerStatus(data_handlers_[card].get(), "card" + std::to_string(card) + "_");
+        }
+    }
+
+    void Controller::PublishMetrics() {
+        // Called with the status mutex held
+        if (!metrics_socket_) return;
+        const std::string metrics = status_->JsonHandlerStatus();
+        // Never hold up the status on the monitoring, a packet it has no room for is dropped
+        if (!metrics_socket_->send(zmq::buffer(metrics), zmq::send_flags::dontwait)) {
+            LOG_DEBUG(logger_, "Metrics not sent, monitoring not keeping up \n");
+        }
+    }
+
     void Controller::ReadStatus() {
-        // This line essentially samples the metrics that are accumulating in the data handler
-        status_->SetDataHandlerStatus(data_handler_.get());
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        SampleDataHandlerStatus();
+        PublishMetrics();
         // tpc_readout_monitor_.setReadoutState(static_cast<uint32_t>(current_state_));
-        status_->ReadStatus(tpc_readout_monitor_, board_slots_, pcie_interface_.get(), false);
+        status_->ReadStatus(tpc_readout_monitor_, board_slots_, pcie_interfaces_.front().get(), false);
         if (!print_status_) {
             // Construct and send a status packet
             // Command cmd(to_telem_u16(TelemetryCodes::TPC_Hardware_Status), status_vec.size());
@@ -401,10 +498,15 @@ namespace controller {
 
         while (run_status_) {
             std::this_thread::sleep_for(std::chrono::seconds(2));
-            tpc_readout_monitor_.setErrorBitWord(data_handler_->getRunErrorCode()); // set the error from the data handler
-            status_->SetDataHandlerStatus(data_handler_.get());
+            std::lock_guard<std::mutex> lock(status_mutex_);
+            // set the error from the data handlers
+            uint32_t run_error_code = 0;
+            for (const auto &data_handler : data_handlers_) run_error_code |= data_handler->getRunErrorCode();
+            tpc_readout_monitor_.setErrorBitWord(run_error_code);
+            SampleDataHandlerStatus();
+            PublishMetrics();
             // tpc_readout_monitor_.setReadoutState(static_cast<uint32_t>(current_state_));
-            status_->ReadStatus(tpc_readout_monitor_, board_slots_, pcie_interface_.get(), false);
+            status_->ReadStatus(tpc_readout_monitor_, board_slots_, pcie_interfaces_.front().get(), false);
             if (!print_status_) {
                 auto tmp_vec = tpc_readout_monitor_.serialize();
                 status_client_->WriteSendBuffer(to_telem_u16(TelemetryCodes::TPC_Hardware_Status), tmp_vec);
@@ -418,8 +520,12 @@ namespace controller {
 
         LOG_INFO(logger_, "Starting Run! \n");
         try {
-            data_handler_->SetRun(true);
-            data_thread_ = std::thread(&data_handler::DataHandler::CollectData, data_handler_.get(), pcie_interface_.get());
+            // The primary goes last so the other card pairs are reading before it starts the trigger
+            for (size_t card = data_handlers_.size(); card-- > 0;) {
+                data_handlers_[card]->SetRun(true);
+                data_threads_.emplace_back(&data_handler::DataHandler::CollectData, data_handlers_[card].get(),
+                                           pcie_interfaces_[card].get());
+            }
             // Start status thread but only if it's not already running
             if (!status_thread_.joinable()) {
                 run_status_.store(true);
@@ -427,11 +533,11 @@ namespace controller {
             }
         } catch (std::exception& ex) {
             LOG_ERROR(logger_, "Exception occurred starting DataHandler: {}", ex.what());
-            data_handler_->SetRun(false);
+            for (const auto &data_handler : data_handlers_) data_handler->SetRun(false);
             return false;
         } catch (...) {
             LOG_ERROR(logger_, "Unknown exception occurred starting DataHandler!");
-            data_handler_->SetRun(false);
+            for (const auto &data_handler : data_handlers_) data_handler->SetRun(false);
             return false;
         }
         return true;
@@ -441,8 +547,11 @@ namespace controller {
         run_status_.store(false);
         if (status_thread_.joinable()) status_thread_.join();
 
-        data_handler_->SetRun(false);
-        if (data_thread_.joinable()) data_thread_.join();
+        for (const auto &data_handler : data_handlers_) data_handler->SetRun(false);
+        for (auto &data_thread : data_threads_) {
+            if (data_thread.joinable()) data_thread.join();
+        }
+        data_threads_.clear();
 
         LOG_INFO(logger_, "Collection thread stopped successfully...\n");
         return true;
@@ -455,7 +564,7 @@ namespace controller {
     bool Controller::Reset() {
         PersistRunId();
         config_["data_handler"]["subrun"] = run_id_;
-        data_handler_->Reset(run_id_);
+        for (const auto &data_handler : data_handlers_) data_handler->Reset(run_id_);
         return true;
     }
 
@@ -6,6 +6,7 @@
 #define CONTROLLER_H
 
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <zmq.hpp>
@@ -96,6 +97,10 @@ namespace controller {
         void ReadStatus();
 
         void InitPcieDriver();
+        bool InitCardPairs();
+        json CardConfig(size_t card);
+        void SampleDataHandlerStatus();
+        void PublishMetrics();
         void ReceiveCommand();
         void SendCallback(uint16_t command, bool success);
         json LoadConfig(const std::string &config_file);
@@ -108,7 +113,13 @@ namespace controller {
         // TCPConnection status_client_;
         std::shared_ptr<TCPConnection> command_client_;
         std::shared_ptr<TCPConnection> status_client_;
-        std::thread data_thread_;
+        // The json metrics are pushed to the monitoring (lib/monitoring/metrics_pub.py) with the status
+        zmq::context_t zmq_context_{1};
+        std::unique_ptr<zmq::socket_t> metrics_socket_;
+        // The status is read from the command and the status threads, the sampling, metrics socket
+        // and status packet are all done under this
+        std::mutex status_mutex_;
+        std::vector<std::thread> data_threads_;
         std::thread status_thread_;
         std::vector<int> board_slots_{};
 
@@ -132,8 +143,12 @@ namespace controller {
         std::unique_ptr<light_fem::LightFem> light_fem_;
         std::unique_ptr<charge_fem::ChargeFem> charge_fem_;
         std::unique_ptr<trig_ctrl::TriggerControl> trigger_ctrl_;
-        std::unique_ptr<data_handler::DataHandler> data_handler_;
-        std::unique_ptr<pcie_int::PCIeInterface> pcie_interface_;
+        // One readout pipeline per PCIe card pair. Pair 0 is the primary, the crate and trigger
+        // are configured and its status read through it.
+        std::vector<std::unique_ptr<data_handler::DataHandler>> data_handlers_;
+        std::vector<std::unique_ptr<pcie_int::PCIeInterface>> pcie_interfaces_;
+        json card_pairs_;
+        std::shared_ptr<data_handler::StorageShare> storage_share_;
         std::unique_ptr<pcie_int::PcieBuffers> buffers_;
         std::unique_ptr<status::Status> status_;
 
@@ -0,0 +1,168 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "async_file_writer.h"
+#include <algorithm>
+#include <unistd.h>
+
+namespace data_handler {
+
+    AsyncFileWriter::~AsyncFileWriter() {
+        Stop();
+    }
+
+    bool AsyncFileWriter::Start(const size_t max_queued_blocks) {
+        Stop();
+        max_queued_blocks_ = std::max(max_queued_blocks, size_t{1});
+        stop_ = false;
+        thread_ = std::thread(&AsyncFileWriter::WriterLoop, this);
+        return true;
+    }
+
+    void AsyncFileWriter::Stop() {
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        thread_.join();
+    }
+
+    void AsyncFileWriter::ResetCounters() {
+        bytes_written_.store(0);
+        num_errors_.store(0);
+        num_open_errors_.store(0);
+        num_dropped_.store(0);
+        num_full_waits_.store(0);
+        max_queued_.store(0);
+        num_files_.store(0);
+    }
+
+    std::unique_ptr<AsyncFileWriter::Task> AsyncFileWriter::AcquireTask() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_tasks_.empty()) return std::make_unique<Task>();
+        auto task = std::move(free_tasks_.back());
+        free_tasks_.pop_back();
+        return task;
+    }
+
+    void AsyncFileWriter::Push(std::unique_ptr<Task> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(task));
+        }
+        work_cv_.notify_one();
+    }
+
+    void AsyncFileWriter::Open(const std::string &file_name, const uint64_t run_number,
+                               const uint64_t subrun_number, const uint64_t config_hash) {
+        auto task = AcquireTask();
+        task->type = TaskType::kOpen;
+        task->file_name = file_name;
+        task->run_number = run_number;
+        task->subrun_number = subrun_number;
+        task->config_hash = config_hash;
+        Push(std::move(task));
+    }
+
+    bool AsyncFileWriter::Write(const uint32_t *words, const size_t num_words, const uint64_t first_event,
+                                const uint64_t last_event, const bool wait) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (num_queued_blocks_ >= max_queued_blocks_) {
+                if (!wait) {
+                    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                num_full_waits_.fetch_add(1, std::memory_order_relaxed);
+                space_cv_.wait(lock, [this] { return num_queued_blocks_ < max_queued_blocks_; });
+            }
+            // Reserve the slot now, the copy is done outside the lock
+            num_queued_blocks_++;
+            if (num_queued_blocks_ > max_queued_.load(std::memory_order_relaxed)) {
+                max_queued_.store(num_queued_blocks_, std::memory_order_relaxed);
+            }
+        }
+        auto task = AcquireTask();
+        task->type = TaskType::kWrite;
+        task->words.assign(words, words + num_words);
+        task->first_event = first_event;
+        task->last_event = last_event;
+        Push(std::move(task));
+        return true;
+    }
+
+    void AsyncFileWriter::Close(const bool sync) {
+        auto task = AcquireTask();
+        task->type = TaskType::kClose;
+        task->sync = sync;
+        Push(std::move(task));
+    }
+
+    void AsyncFileWriter::Drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+    }
+
+    void AsyncFileWriter::CloseFile(const bool sync) {
+        if (!writer_.IsOpen()) return;
+        const int fd = writer_.Finish();
+        if (sync && fsync(fd) == -1) num_errors_.fetch_add(1, std::memory_order_relaxed);
+        if (close(fd) == -1) num_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void AsyncFileWriter::Execute(Task &task) {
+        switch (task.type) {
+            case TaskType::kOpen:
+                CloseFile(false);
+                if (writer_.Open(task.file_name, task.run_number, task.subrun_number, task.config_hash)) {
+                    num_files_.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    num_errors_.fetch_add(1, std::memory_order_relaxed);
+                    num_open_errors_.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            case TaskType::kWrite: {
+                const ssize_t n = writer_.WriteBlock(task.words.data(), task.words.size(), task.first_event, task.last_event);
+                if (n == -1) {
+                    num_errors_.fetch_add(1, std::memory_order_relaxed);
+                    if (loss_ledger_) loss_ledger_->Record(LossReason::kWriteFailed, task.last_event - task.first_event + 1);
+                } else bytes_written_.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+                break;
+            }
+            case TaskType::kClose:
+                CloseFile(task.sync);
+                break;
+        }
+    }
+
+    void AsyncFileWriter::WriterLoop() {
+        while (true) {
+            std::unique_ptr<Task> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                // Only stop once the queue is empty so no data is lost at the end of a run
+                if (queue_.empty()) break;
+                task = std::move(queue_.front());
+                queue_.pop_front();
+                busy_ = true;
+            }
+
+            Execute(*task);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (task->type == TaskType::kWrite) num_queued_blocks_--;
+                busy_ = false;
+                free_tasks_.push_back(std::move(task));
+            }
+            space_cv_.notify_all();
+        }
+        // A file left open by the caller is synced and closed here
+        CloseFile(true);
+    }
+
+} // data_handler
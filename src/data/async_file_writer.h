@@ -0,0 +1,116 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef ASYNC_FILE_WRITER_H
+#define ASYNC_FILE_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "data_file.h"
+#include "loss_ledger.h"
+
+namespace data_handler {
+
+/*
+ * A `DataFileWriter` driven by its own thread. The write thread queues open, write and close
+ * requests which are carried out in order, so a slow disk only holds up its own queue. Blocks
+ * are copied into the queue, at most `max_queued_blocks` at a time. When the queue is full
+ * `Write()` either waits for space or drops the block, depending on the caller.
+ * Open/close requests are never dropped. With a `LossLedger` set, the events of blocks which
+ * fail to write (no file open or a write error) are recorded as kWriteFailed.
+ */
+class AsyncFileWriter {
+public:
+
+    AsyncFileWriter() = default;
+    ~AsyncFileWriter();
+
+    // Only while stopped
+    void SetContainer(const bool use_container) { writer_.SetContainer(use_container); }
+    void SetManifest(const bool write_manifest) { writer_.SetManifest(write_manifest); }
+    void SetHeaderFlags(const uint32_t flags) { writer_.SetHeaderFlags(flags); }
+    void SetFlusher(FileFlusher *flusher) { writer_.SetFlusher(flusher); }
+    void SetLossLedger(LossLedger *loss_ledger) { loss_ledger_ = loss_ledger; }
+
+    bool Start(size_t max_queued_blocks);
+    // Carries out everything still queued, closes an open file and joins the thread
+    void Stop();
+    bool IsRunning() const { return thread_.joinable(); }
+
+    void Open(const std::string &file_name, uint64_t run_number, uint64_t subrun_number, uint64_t config_hash);
+    // Queue a copy of the block, false if it was dropped because the queue is full and `wait` is false
+    bool Write(const uint32_t *words, size_t num_words, uint64_t first_event, uint64_t last_event, bool wait);
+    // Finish the file, with `sync` it is flushed to disk before it is closed
+    void Close(bool sync);
+    // Block until everything queued so far has been carried out
+    void Drain();
+
+    // Counters, can be read from any thread
+    uint64_t BytesWritten() const { return bytes_written_.load(std::memory_order_relaxed); }
+    uint64_t NumErrors() const { return num_errors_.load(std::memory_order_relaxed); }
+    uint64_t NumOpenErrors() const { return num_open_errors_.load(std::memory_order_relaxed); }
+    uint64_t NumDropped() const { return num_dropped_.load(std::memory_order_relaxed); }
+    uint64_t NumFullWaits() const { return num_full_waits_.load(std::memory_order_relaxed); }
+    size_t MaxQueued() const { return max_queued_.load(std::memory_order_relaxed); }
+    size_t NumFiles() const { return num_files_.load(std::memory_order_relaxed); }
+    uint64_t ChecksumNs() const { return writer_.ChecksumNs(); }
+    void ResetCounters();
+
+private:
+
+    enum class TaskType { kOpen, kWrite, kClose };
+
+    struct Task {
+        TaskType type = TaskType::kWrite;
+        std::string file_name;
+        uint64_t run_number = 0;
+        uint64_t subrun_number = 0;
+        uint64_t config_hash = 0;
+        uint64_t first_event = 0;
+        uint64_t last_event = 0;
+        bool sync = false;
+        std::vector<uint32_t> words;
+    };
+
+    std::unique_ptr<Task> AcquireTask();
+    void Push(std::unique_ptr<Task> task);
+    void WriterLoop();
+    void Execute(Task &task);
+    void CloseFile(bool sync);
+
+    DataFileWriter writer_{};
+    LossLedger *loss_ledger_ = nullptr;
+    size_t max_queued_blocks_ = 8;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable space_cv_;
+    bool stop_ = false;
+    bool busy_ = false;
+    size_t num_queued_blocks_ = 0;
+    std::deque<std::unique_ptr<Task>> queue_;
+    std::vector<std::unique_ptr<Task>> free_tasks_;
+    std::thread thread_;
+
+    std::atomic<uint64_t> bytes_written_ = 0;
+    std::atomic<uint64_t> num_errors_ = 0;
+    std::atomic<uint64_t> num_open_errors_ = 0;
+    std::atomic<uint64_t> num_dropped_ = 0;
+    std::atomic<uint64_t> num_full_waits_ = 0;
+    std::atomic<size_t> max_queued_ = 0;
+    std::atomic<size_t> num_files_ = 0;
+};
+
+} // data_handler
+
+#endif //ASYNC_FILE_WRITER_H
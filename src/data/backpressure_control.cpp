@@ -0,0 +1,76 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "backpressure_control.h"
+#include <algorithm>
+
+namespace data_handler {
+
+    void BackpressureControl::Configure(bool enable, double high_watermark, double low_watermark) {
+        enable_ = enable;
+        // Keep the watermarks sane, the low watermark must be below the high one
+        // otherwise we would never leave the throttled state.
+        high_watermark_ = std::clamp(high_watermark, 0.05, 0.99);
+        low_watermark_ = std::clamp(low_watermark, 0.0, high_watermark_ - 0.01);
+    }
+
+    void BackpressureControl::Reset() {
+        is_throttled_.store(false);
+        num_throttles_.store(0);
+        max_occupancy_.store(0);
+        run_start_ns_.store(ToNs(Clock::now()));
+        run_end_ns_.store(0);
+        throttle_start_ns_.store(0);
+        dead_time_ns_.store(0);
+    }
+
+    BackpressureControl::Action BackpressureControl::Update(size_t occupancy, size_t capacity) {
+        if (occupancy > max_occupancy_.load()) max_occupancy_.store(occupancy);
+        if (!enable_ || capacity == 0) return Action::kNone;
+
+        const double fill = static_cast<double>(occupancy) / static_cast<double>(capacity);
+        if (!is_throttled_.load() && fill >= high_watermark_) {
+            throttle_start_ns_.store(ToNs(Clock::now()));
+            is_throttled_.store(true);
+            num_throttles_++;
+            return Action::kThrottle;
+        }
+        if (is_throttled_.load() && fill <= low_watermark_) {
+            dead_time_ns_ += ToNs(Clock::now()) - throttle_start_ns_.load();
+            throttle_start_ns_.store(0);
+            is_throttled_.store(false);
+            return Action::kResume;
+        }
+        return Action::kNone;
+    }
+
+    void BackpressureControl::Finish() {
+        const uint64_t now = ToNs(Clock::now());
+        // Close out a throttle period which was still open when the run stopped
+        if (is_throttled_.load()) {
+            dead_time_ns_ += now - throttle_start_ns_.load();
+            throttle_start_ns_.store(0);
+            is_throttled_.store(false);
+        }
+        run_end_ns_.store(now);
+    }
+
+    uint64_t BackpressureControl::DeadTimeMs() const {
+        uint64_t dead_time = dead_time_ns_.load();
+        const uint64_t throttle_start = throttle_start_ns_.load();
+        // Include the currently open throttle period so the metric is live
+        if (throttle_start > 0) dead_time += ToNs(Clock::now()) - throttle_start;
+        return dead_time / 1000000;
+    }
+
+    uint64_t BackpressureControl::LiveTimeMs() const {
+        const uint64_t run_start = run_start_ns_.load();
+        if (run_start == 0) return 0;
+        const uint64_t run_end = run_end_ns_.load() > 0 ? run_end_ns_.load() : ToNs(Clock::now());
+        const uint64_t run_time_ms = (run_end - run_start) / 1000000;
+        const uint64_t dead_time_ms = DeadTimeMs();
+        return run_time_ms > dead_time_ms ? run_time_ms - dead_time_ms : 0;
+    }
+
+} // data_handler
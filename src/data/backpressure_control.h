@@ -0,0 +1,69 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef BACKPRESSURE_CONTROL_H
+#define BACKPRESSURE_CONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace data_handler {
+
+/*
+ * Watches the occupancy of the read/write queue and decides when the triggers should be
+ * paused so the write thread can catch up. Above the high watermark we throttle, below the
+ * low watermark we resume, the gap between the two gives the hysteresis so we don't toggle
+ * the trigger on every DMA. The time spent throttled is accumulated as dead time so the
+ * live time of the run is known, rather than silently losing data when the queue fills.
+ *
+ * `Update()` is only called from the read thread, the metric getters can be called from
+ * any thread.
+ */
+class BackpressureControl {
+public:
+
+    enum class Action { kNone, kThrottle, kResume };
+
+    BackpressureControl() = default;
+    ~BackpressureControl() = default;
+
+    void Configure(bool enable, double high_watermark, double low_watermark);
+    void Reset();
+    Action Update(size_t occupancy, size_t capacity);
+    void Finish();
+
+    bool IsEnabled() const { return enable_; }
+    bool IsThrottled() const { return is_throttled_.load(); }
+    size_t NumThrottles() const { return num_throttles_.load(); }
+    size_t MaxOccupancy() const { return max_occupancy_.load(); }
+    uint64_t DeadTimeMs() const;
+    uint64_t LiveTimeMs() const;
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    static uint64_t ToNs(Clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    bool enable_ = true;
+    double high_watermark_ = 0.75;
+    double low_watermark_ = 0.25;
+
+    std::atomic_bool is_throttled_ = false;
+    std::atomic<size_t> num_throttles_ = 0;
+    std::atomic<size_t> max_occupancy_ = 0;
+    // Time stamps in ns from the steady clock, zero if not set
+    std::atomic<uint64_t> run_start_ns_ = 0;
+    std::atomic<uint64_t> run_end_ns_ = 0;
+    std::atomic<uint64_t> throttle_start_ns_ = 0;
+    std::atomic<uint64_t> dead_time_ns_ = 0;
+};
+
+} // data_handler
+
+#endif //BACKPRESSURE_CONTROL_H
@@ -0,0 +1,235 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "compression.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace data_handler {
+
+    namespace {
+        constexpr size_t kHeaderWords = sizeof(CompressedFrameHeader) / sizeof(uint32_t);
+
+        size_t BytesToWords(const size_t num_bytes) {
+            return (num_bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+        }
+
+#ifdef HAVE_ZSTD
+        // One context per thread, creating them per frame is expensive
+        struct ZstdContexts {
+            ZSTD_CCtx *cctx = ZSTD_createCCtx();
+            ZSTD_DCtx *dctx = ZSTD_createDCtx();
+            ~ZstdContexts() {
+                ZSTD_freeCCtx(cctx);
+                ZSTD_freeDCtx(dctx);
+            }
+        };
+
+        ZstdContexts &ThreadContexts() {
+            thread_local ZstdContexts contexts;
+            return contexts;
+        }
+#endif
+    }
+
+    bool CodecAvailable(const Codec codec) {
+        switch (codec) {
+            case Codec::kNone: return true;
+#ifdef HAVE_ZSTD
+            case Codec::kZstd: return true;
+#endif
+            default: return false;
+        }
+    }
+
+    bool CompressFrame(const Codec codec, const int level, const uint32_t *words, const size_t num_words,
+                       std::vector<uint32_t> &frame) {
+        const size_t original_bytes = num_words * sizeof(uint32_t);
+        if (original_bytes > UINT32_MAX) return false;
+
+        size_t compressed_bytes = 0;
+        switch (codec) {
+            case Codec::kNone: {
+                frame.resize(kHeaderWords + num_words);
+                std::memcpy(frame.data() + kHeaderWords, words, original_bytes);
+                compressed_bytes = original_bytes;
+                break;
+            }
+#ifdef HAVE_ZSTD
+            case Codec::kZstd: {
+                frame.resize(kHeaderWords + BytesToWords(ZSTD_compressBound(original_bytes)));
+                compressed_bytes = ZSTD_compressCCtx(ThreadContexts().cctx, frame.data() + kHeaderWords,
+                                                     (frame.size() - kHeaderWords) * sizeof(uint32_t),
+                                                     words, original_bytes, level);
+                if (ZSTD_isError(compressed_bytes)) return false;
+                break;
+            }
+#endif
+            default: return false;
+        }
+
+        // Zero the padding so the file contents are deterministic
+        const size_t frame_words = kHeaderWords + BytesToWords(compressed_bytes);
+        auto *payload_bytes = reinterpret_cast<uint8_t *>(frame.data() + kHeaderWords);
+        std::memset(payload_bytes + compressed_bytes, 0, (frame_words - kHeaderWords) * sizeof(uint32_t) - compressed_bytes);
+        frame.resize(frame_words);
+
+        CompressedFrameHeader header{};
+        header.magic = CompressedFrameHeader::kMagic;
+        header.codec = static_cast<uint8_t>(codec);
+        header.level = static_cast<uint8_t>(level);
+        header.compressed_bytes = static_cast<uint32_t>(compressed_bytes);
+        header.original_bytes = static_cast<uint32_t>(original_bytes);
+        std::memcpy(frame.data(), &header, sizeof(header));
+        return true;
+    }
+
+    bool IsCompressedFrame(const uint32_t *words, const size_t num_words) {
+        return num_words >= kHeaderWords && words[0] == CompressedFrameHeader::kMagic;
+    }
+
+    bool DecompressFrame(const uint32_t *frame, const size_t frame_words, std::vector<uint32_t> &words) {
+        if (!IsCompressedFrame(frame, frame_words)) return false;
+        CompressedFrameHeader header{};
+        std::memcpy(&header, frame, sizeof(header));
+        if (BytesToWords(header.compressed_bytes) > frame_words - kHeaderWords ||
+            (header.original_bytes % sizeof(uint32_t)) != 0) return false;
+
+        words.resize(header.original_bytes / sizeof(uint32_t));
+        switch (static_cast<Codec>(header.codec)) {
+            case Codec::kNone: {
+                if (header.compressed_bytes != header.original_bytes) return false;
+                std::memcpy(words.data(), frame + kHeaderWords, header.original_bytes);
+                return true;
+            }
+#ifdef HAVE_ZSTD
+            case Codec::kZstd: {
+                const size_t num_bytes = ZSTD_decompressDCtx(ThreadContexts().dctx, words.data(), header.original_bytes,
+                                                             frame + kHeaderWords, header.compressed_bytes);
+                return !ZSTD_isError(num_bytes) && num_bytes == header.original_bytes;
+            }
+#endif
+            default: return false;
+        }
+    }
+
+    // ----------------------------------------
+    // Worker pool
+
+    CompressionPool::~CompressionPool() {
+        Stop();
+    }
+
+    bool CompressionPool::Start(const size_t num_workers, const Codec codec, const int level, const size_t max_in_flight) {
+        Stop();
+        if (num_workers == 0 || !CodecAvailable(codec)) return false;
+        codec_ = codec;
+        level_ = level;
+        max_in_flight_ = std::max(max_in_flight, num_workers);
+        stop_ = false;
+        for (size_t i = 0; i < num_workers; i++) {
+            workers_.emplace_back(&CompressionPool::WorkerLoop, this);
+        }
+        return true;
+    }
+
+    void CompressionPool::Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (auto &worker : workers_) {
+            if (worker.joinable()) worker.join();
+        }
+        workers_.clear();
+        // Anything not collected is dropped, the write thread drains the pool before stopping it
+        in_order_.clear();
+        todo_.clear();
+    }
+
+    void CompressionPool::ResetCounters() {
+        bytes_in_.store(0);
+        bytes_out_.store(0);
+        num_failed_.store(0);
+    }
+
+    std::unique_ptr<CompressionPool::Job> CompressionPool::AcquireJob() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_jobs_.empty()) return std::make_unique<Job>();
+        auto job = std::move(free_jobs_.back());
+        free_jobs_.pop_back();
+        return job;
+    }
+
+    void CompressionPool::RecycleJob(std::unique_ptr<Job> job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Keep enough buffers for a full pipeline, more would just hold memory
+        if (free_jobs_.size() < max_in_flight_ + 1) free_jobs_.push_back(std::move(job));
+    }
+
+    void CompressionPool::Submit(std::unique_ptr<Job> job) {
+        auto slot = std::make_shared<Slot>();
+        slot->job = std::move(job);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_order_.push_back(slot);
+            todo_.push_back(slot);
+        }
+        work_cv_.notify_one();
+    }
+
+    std::unique_ptr<CompressionPool::Job> CompressionPool::NextDone(const bool wait) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (wait) done_cv_.wait(lock, [this] { return in_order_.empty() || in_order_.front()->done; });
+        if (in_order_.empty() || !in_order_.front()->done) return nullptr;
+        auto job = std::move(in_order_.front()->job);
+        in_order_.pop_front();
+        return job;
+    }
+
+    size_t CompressionPool::InFlight() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_order_.size();
+    }
+
+    bool CompressionPool::IsFull() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_order_.size() >= max_in_flight_;
+    }
+
+    void CompressionPool::WorkerLoop() {
+        while (true) {
+            std::shared_ptr<Slot> slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [this] { return stop_ || !todo_.empty(); });
+                if (stop_) return;
+                slot = todo_.front();
+                todo_.pop_front();
+            }
+
+            Job &job = *slot->job;
+            job.compressed = CompressFrame(codec_, level_, job.words.data(), job.words.size(), job.frame);
+            bytes_in_.fetch_add(job.words.size() * sizeof(uint32_t), std::memory_order_relaxed);
+            if (job.compressed) {
+                bytes_out_.fetch_add(job.frame.size() * sizeof(uint32_t), std::memory_order_relaxed);
+            } else {
+                bytes_out_.fetch_add(job.words.size() * sizeof(uint32_t), std::memory_order_relaxed);
+                num_failed_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                slot->done = true;
+            }
+            done_cv_.notify_all();
+        }
+    }
+
+} // data_handler
@@ -0,0 +1,129 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace data_handler {
+
+/*
+ * Software compression of the event stream before it is written to disk.
+ *
+ * A write chunk is compressed into one frame which replaces the raw words in the file:
+ *  [CompressedFrameHeader][compressed bytes][0-3B padding to a 32b boundary]
+ * The header records the codec and the original length so the frame can be restored
+ * exactly with `DecompressFrame()`. Raw chunks always start with the event start marker
+ * 0xFFFFFFFF so the frame magic can not be confused with uncompressed data.
+ *
+ * zstd is used when the build finds libzstd (HAVE_ZSTD), otherwise compression is unavailable
+ * and the data is written raw.
+ */
+
+enum class Codec : uint8_t {
+    kNone = 0,
+    kZstd = 1,
+};
+
+struct CompressedFrameHeader {
+    static constexpr uint32_t kMagic = 0x504D4347; // "GCMP"
+
+    uint32_t magic;
+    uint8_t codec;
+    uint8_t level;
+    uint16_t reserved;
+    uint32_t compressed_bytes;
+    uint32_t original_bytes;
+};
+
+static_assert(sizeof(CompressedFrameHeader) == 16, "CompressedFrameHeader layout changed");
+
+bool CodecAvailable(Codec codec);
+
+// Compress `num_words` into `frame`, returns false if the codec failed or is not available
+bool CompressFrame(Codec codec, int level, const uint32_t *words, size_t num_words, std::vector<uint32_t> &frame);
+bool IsCompressedFrame(const uint32_t *words, size_t num_words);
+// Restore the original words of a frame, returns false if the frame is corrupt
+bool DecompressFrame(const uint32_t *frame, size_t frame_words, std::vector<uint32_t> &words);
+
+/*
+ * Pool of worker threads compressing write chunks in parallel. The write thread submits
+ * chunks and collects the finished frames in submission order, so the blocks in the file
+ * stay in event order. Once `IsFull()` the write thread has to wait on `NextDone(true)`
+ * before submitting more, this bounds the memory and pushes back on the write thread if
+ * the workers fall behind.
+ */
+class CompressionPool {
+public:
+
+    struct Job {
+        uint64_t first_event = 0;
+        uint64_t last_event = 0;
+        std::vector<uint32_t> words;
+        std::vector<uint32_t> frame;
+        bool compressed = false; // false if compression failed, `words` is written instead
+    };
+
+    CompressionPool() = default;
+    ~CompressionPool();
+
+    bool Start(size_t num_workers, Codec codec, int level, size_t max_in_flight);
+    void Stop();
+    bool IsRunning() const { return !workers_.empty(); }
+
+    // Reuse the buffers of finished jobs rather than allocating new ones for every chunk
+    std::unique_ptr<Job> AcquireJob();
+    void RecycleJob(std::unique_ptr<Job> job);
+
+    void Submit(std::unique_ptr<Job> job);
+    // Oldest submitted job if it is finished, or nullptr. With `wait` it blocks until the
+    // oldest job is done, nullptr only if nothing is in flight.
+    std::unique_ptr<Job> NextDone(bool wait);
+    size_t InFlight();
+    bool IsFull();
+
+    uint64_t BytesIn() const { return bytes_in_.load(std::memory_order_relaxed); }
+    uint64_t BytesOut() const { return bytes_out_.load(std::memory_order_relaxed); }
+    uint64_t NumFailed() const { return num_failed_.load(std::memory_order_relaxed); }
+    void ResetCounters();
+
+private:
+
+    struct Slot {
+        std::unique_ptr<Job> job;
+        bool done = false;
+    };
+
+    void WorkerLoop();
+
+    Codec codec_ = Codec::kNone;
+    int level_ = 1;
+    size_t max_in_flight_ = 4;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    bool stop_ = false;
+    std::deque<std::shared_ptr<Slot>> in_order_; // all jobs in flight, in submission order
+    std::deque<std::shared_ptr<Slot>> todo_;     // jobs not picked up by a worker yet
+    std::vector<std::unique_ptr<Job>> free_jobs_;
+    std::vector<std::thread> workers_;
+
+    std::atomic<uint64_t> bytes_in_ = 0;
+    std::atomic<uint64_t> bytes_out_ = 0;
+    std::atomic<uint64_t> num_failed_ = 0;
+};
+
+} // data_handler
+
+#endif //COMPRESSION_H
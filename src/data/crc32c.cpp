@@ -0,0 +1,99 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "crc32c.h"
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace data_handler {
+
+    namespace {
+        constexpr uint32_t kCrc32cPoly = 0x82F63B78;
+
+        // Table k gives the CRC of a byte followed by k zero bytes, for slicing-by-8
+        constexpr std::array<std::array<uint32_t, 256>, 8> MakeCrcTables() {
+            std::array<std::array<uint32_t, 256>, 8> tables{};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; bit++) crc = (crc & 1) ? (crc >> 1) ^ kCrc32cPoly : (crc >> 1);
+                tables[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; i++) {
+                for (size_t k = 1; k < 8; k++) {
+                    tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xFF];
+                }
+            }
+            return tables;
+        }
+
+        constexpr auto kCrcTables = MakeCrcTables();
+
+        uint32_t Crc32cSlicing8(const uint8_t *bytes, size_t num_bytes, uint32_t crc) {
+            // Process 8B per step with 8 table lookups instead of 8 dependent ones
+            while (num_bytes >= 8) {
+                uint64_t block;
+                std::memcpy(&block, bytes, sizeof(block));
+                block ^= crc;
+                crc = kCrcTables[7][block & 0xFF] ^
+                      kCrcTables[6][(block >> 8) & 0xFF] ^
+                      kCrcTables[5][(block >> 16) & 0xFF] ^
+                      kCrcTables[4][(block >> 24) & 0xFF] ^
+                      kCrcTables[3][(block >> 32) & 0xFF] ^
+                      kCrcTables[2][(block >> 40) & 0xFF] ^
+                      kCrcTables[1][(block >> 48) & 0xFF] ^
+                      kCrcTables[0][block >> 56];
+                bytes += 8;
+                num_bytes -= 8;
+            }
+            while (num_bytes-- > 0) {
+                crc = kCrcTables[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+            }
+            return crc;
+        }
+
+#if defined(__x86_64__)
+        // Built for SSE4.2 regardless of the compile flags, only called if the CPU has it
+        __attribute__((target("sse4.2")))
+        uint32_t Crc32cHardware(const uint8_t *bytes, size_t num_bytes, uint32_t crc) {
+            uint64_t crc64 = crc;
+            while (num_bytes >= 8) {
+                uint64_t block;
+                std::memcpy(&block, bytes, sizeof(block));
+                crc64 = _mm_crc32_u64(crc64, block);
+                bytes += 8;
+                num_bytes -= 8;
+            }
+            crc = static_cast<uint32_t>(crc64);
+            while (num_bytes-- > 0) {
+                crc = _mm_crc32_u8(crc, *bytes++);
+            }
+            return crc;
+        }
+
+        const bool kHasSse42 = __builtin_cpu_supports("sse4.2");
+#endif
+    }
+
+    bool Crc32cIsHardware() {
+#if defined(__x86_64__)
+        return kHasSse42;
+#else
+        return false;
+#endif
+    }
+
+    uint32_t Crc32c(const void *data, size_t num_bytes, uint32_t crc) {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        crc = ~crc;
+#if defined(__x86_64__)
+        if (kHasSse42) return ~Crc32cHardware(bytes, num_bytes, crc);
+#endif
+        return ~Crc32cSlicing8(bytes, num_bytes, crc);
+    }
+
+} // data_handler
@@ -0,0 +1,25 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace data_handler {
+
+/*
+ * CRC32C (Castagnoli, reflected polynomial 0x82F63B78) as used by iSCSI/ext4, so files can be
+ * checked with standard tools. Pass the previous result as `crc` to checksum data in pieces.
+ *
+ * Uses the SSE4.2 crc32 instruction when the CPU has it (checked at run time, so no special
+ * compile flags are needed) and falls back to a slicing-by-8 table otherwise.
+ */
+uint32_t Crc32c(const void *data, size_t num_bytes, uint32_t crc = 0);
+bool Crc32cIsHardware();
+
+} // data_handler
+
+#endif //CRC32C_H
@@ -0,0 +1,405 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "data_file.h"
+#include "crc32c.h"
+#include "compression.h"
+#include "sample_packing.h"
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace data_handler {
+
+    namespace {
+        int64_t HostTimeNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        uint64_t SteadyNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // CRC of a struct up to (not including) its own CRC field
+        template <typename T>
+        uint32_t StructCrc(const T &data, const size_t crc_offset) {
+            return Crc32c(&data, crc_offset);
+        }
+    }
+
+    uint64_t ConfigHash(const std::string &config) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (const char c : config) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    bool WriteManifest(const std::string &file_name, const std::vector<ChecksumEntry> &entries) {
+        const std::string manifest_name = file_name + kManifestSuffix;
+        FILE *manifest = std::fopen(manifest_name.c_str(), "w");
+        if (manifest == nullptr) return false;
+        std::fprintf(manifest, "# crc32c manifest v1 for %s\n", file_name.c_str());
+        for (const auto &entry : entries) {
+            std::fprintf(manifest, "%" PRIu64 " %" PRIu64 " %08" PRIx32 "\n", entry.offset, entry.num_bytes, entry.crc);
+        }
+        const bool ok = std::ferror(manifest) == 0;
+        return (std::fclose(manifest) == 0) && ok;
+    }
+
+    bool ReadManifest(const std::string &file_name, std::vector<ChecksumEntry> &entries) {
+        entries.clear();
+        FILE *manifest = std::fopen(file_name.c_str(), "r");
+        if (manifest == nullptr) return false;
+        char line[256];
+        bool ok = true;
+        while (std::fgets(line, sizeof(line), manifest) != nullptr) {
+            if (line[0] == '#' || line[0] == '\n') continue;
+            ChecksumEntry entry{};
+            if (std::sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNx32, &entry.offset, &entry.num_bytes, &entry.crc) != 3) {
+                ok = false;
+                break;
+            }
+            entries.push_back(entry);
+        }
+        std::fclose(manifest);
+        return ok;
+    }
+
+    // ----------------------------------------
+    // Writer
+
+    bool DataFileWriter::WriteAll(const void *data, size_t num_bytes) {
+        const auto *bytes = static_cast<const char *>(data);
+        while (num_bytes > 0) {
+            const ssize_t n = write(fd_, bytes, num_bytes);
+            if (n == -1) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            bytes += n;
+            num_bytes -= static_cast<size_t>(n);
+            offset_ += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    bool DataFileWriter::Append(const void *data, const size_t num_bytes) {
+        if (map_ == nullptr) return WriteAll(data, num_bytes);
+        if (offset_ + num_bytes > map_bytes_) {
+            errno = ENOSPC;
+            return false;
+        }
+        std::memcpy(map_ + offset_, data, num_bytes);
+        offset_ += num_bytes;
+        return true;
+    }
+
+    uint32_t *DataFileWriter::MappedBuffer() const {
+        if (map_ == nullptr) return nullptr;
+        const size_t header_bytes = use_container_ ? sizeof(BlockHeader) : 0;
+        return reinterpret_cast<uint32_t *>(map_ + offset_ + header_bytes);
+    }
+
+    size_t DataFileWriter::MappedCapacity() const {
+        const size_t header_bytes = use_container_ ? sizeof(BlockHeader) : 0;
+        if (map_ == nullptr || offset_ + header_bytes > map_bytes_) return 0;
+        return (map_bytes_ - offset_ - header_bytes) / sizeof(uint32_t);
+    }
+
+    bool DataFileWriter::Unmap() {
+        if (map_ == nullptr) return true;
+        munmap(map_, map_bytes_);
+        map_ = nullptr;
+        // Give back the preallocated space past the data and continue with write() from there
+        const bool truncated = ftruncate(fd_, static_cast<off_t>(offset_)) == 0;
+        return lseek(fd_, static_cast<off_t>(offset_), SEEK_SET) != -1 && truncated;
+    }
+
+    bool DataFileWriter::Open(const std::string &file_name, const uint64_t run_number,
+                              const uint64_t subrun_number, const uint64_t config_hash) {
+        // 0644 user, group and others read/write permissions. The mapping needs read access.
+        fd_ = open(file_name.c_str(), (map_bytes_ > 0 ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0644);
+        if (fd_ == -1) return false;
+        file_name_ = file_name;
+        offset_ = 0;
+        block_index_.clear();
+        checksums_.clear();
+        if (map_bytes_ > 0) {
+            // Reserve the blocks now, a sparse mapping would SIGBUS rather than fail if the disk fills
+            void *map = MAP_FAILED;
+            if (posix_fallocate(fd_, 0, static_cast<off_t>(map_bytes_)) == 0) {
+                map = mmap(nullptr, map_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            }
+            if (map == MAP_FAILED) {
+                const int error = errno;
+                close(fd_);
+                fd_ = -1;
+                errno = error;
+                return false;
+            }
+            map_ = static_cast<uint8_t *>(map);
+            madvise(map_, map_bytes_, MADV_SEQUENTIAL);
+        }
+        if (flusher_) flush_file_ = flusher_->Attach(fd_);
+        if (!use_container_) return true;
+
+        FileHeader header{};
+        header.magic = FileHeader::kMagic;
+        header.version = FileHeader::kVersion;
+        header.header_size = sizeof(FileHeader);
+        header.run_number = run_number;
+        header.subrun_number = subrun_number;
+        header.config_hash = config_hash;
+        header.start_time_ns = HostTimeNs();
+        header.flags = header_flags_;
+        header.header_crc = StructCrc(header, offsetof(FileHeader, header_crc));
+        return Append(&header, sizeof(header));
+    }
+
+    ssize_t DataFileWriter::WriteBlock(const uint32_t *words, const size_t num_words,
+                                       const uint64_t first_event, const uint64_t last_event) {
+        if (fd_ == -1) return -1;
+        const size_t num_bytes = num_words * sizeof(uint32_t);
+        if (map_ != nullptr && words != MappedBuffer()) {
+            // Built somewhere else, copy it into place
+            if (num_words > MappedCapacity()) {
+                errno = ENOSPC;
+                return -1;
+            }
+            std::memmove(MappedBuffer(), words, num_bytes);
+            words = MappedBuffer();
+        }
+        const uint64_t checksum_start = SteadyNs();
+        const uint32_t payload_crc = Crc32c(words, num_bytes);
+        checksum_ns_.fetch_add(SteadyNs() - checksum_start, std::memory_order_relaxed);
+
+        if (!use_container_) {
+            checksums_.push_back({offset_, num_bytes, payload_crc});
+            if (map_ != nullptr) offset_ += num_bytes; // already in place
+            else if (!WriteAll(words, num_bytes)) return -1;
+            if (flush_file_) flusher_->Written(flush_file_, offset_);
+            return static_cast<ssize_t>(num_bytes);
+        }
+
+        BlockHeader block_header{};
+        block_header.magic = BlockHeader::kMagic;
+        block_header.header_size = sizeof(BlockHeader);
+        block_header.payload_bytes = num_bytes;
+        block_header.first_event = first_event;
+        block_header.last_event = last_event;
+        block_header.host_time_ns = HostTimeNs();
+        block_header.payload_crc = payload_crc;
+        block_header.header_crc = StructCrc(block_header, offsetof(BlockHeader, header_crc));
+
+        const uint64_t block_offset = offset_;
+        if (map_ != nullptr) {
+            // The payload is already in place behind the header
+            std::memcpy(map_ + offset_, &block_header, sizeof(block_header));
+            offset_ += sizeof(block_header) + num_bytes;
+            block_index_.push_back({block_offset, first_event, last_event});
+            checksums_.push_back({block_offset + sizeof(BlockHeader), num_bytes, payload_crc});
+            if (flush_file_) flusher_->Written(flush_file_, offset_);
+            return static_cast<ssize_t>(num_bytes);
+        }
+        // Header and payload in one syscall, fall back to plain writes for the remainder
+        // if the kernel only took part of it.
+        iovec iov[2] = {{&block_header, sizeof(block_header)},
+                        {const_cast<uint32_t *>(words), num_bytes}};
+        ssize_t n;
+        do {
+            n = writev(fd_, iov, 2);
+        } while (n == -1 && errno == EINTR);
+        if (n == -1) return -1;
+        offset_ += static_cast<uint64_t>(n);
+
+        const auto total_bytes = static_cast<size_t>(n);
+        if (total_bytes < sizeof(block_header)) {
+            const auto *header_bytes = reinterpret_cast<const char *>(&block_header);
+            if (!WriteAll(header_bytes + total_bytes, sizeof(block_header) - total_bytes)) return -1;
+            if (!WriteAll(words, num_bytes)) return -1;
+        } else if (total_bytes < sizeof(block_header) + num_bytes) {
+            const size_t payload_done = total_bytes - sizeof(block_header);
+            if (!WriteAll(reinterpret_cast<const char *>(words) + payload_done, num_bytes - payload_done)) return -1;
+        }
+
+        block_index_.push_back({block_offset, first_event, last_event});
+        checksums_.push_back({block_offset + sizeof(BlockHeader), num_bytes, payload_crc});
+        if (flush_file_) flusher_->Written(flush_file_, offset_);
+        return static_cast<ssize_t>(num_bytes);
+    }
+
+    int DataFileWriter::Finish() {
+        // Without the truncate the reader would find the index past the preallocated space,
+        // leave the trailer out and let it scan the blocks instead
+        const bool can_append = Unmap();
+        const int fd = fd_;
+        if (fd_ != -1 && use_container_ && can_append) {
+            FileTrailer trailer{};
+            trailer.magic = FileTrailer::kMagic;
+            trailer.num_blocks = static_cast<uint32_t>(block_index_.size());
+            trailer.index_offset = offset_;
+            trailer.end_time_ns = HostTimeNs();
+            trailer.index_crc = Crc32c(block_index_.data(), block_index_.size() * sizeof(BlockIndexEntry));
+            trailer.trailer_crc = StructCrc(trailer, offsetof(FileTrailer, trailer_crc));
+            // A failed trailer only costs the reader a scan, the blocks are still intact
+            if (WriteAll(block_index_.data(), block_index_.size() * sizeof(BlockIndexEntry))) {
+                WriteAll(&trailer, sizeof(trailer));
+            }
+        }
+        // Losing the manifest is not fatal, the container blocks carry their own CRC
+        if (fd_ != -1 && write_manifest_) WriteManifest(file_name_, checksums_);
+        // The flusher has its own fd so the caller is free to close this one
+        if (flush_file_) flusher_->Detach(flush_file_, offset_);
+        flush_file_.reset();
+        fd_ = -1;
+        offset_ = 0;
+        block_index_.clear();
+        checksums_.clear();
+        return fd;
+    }
+
+    // ----------------------------------------
+    // Reader
+
+    DataFileReader::~DataFileReader() {
+        Close();
+    }
+
+    bool DataFileReader::ReadAt(void *data, size_t num_bytes, uint64_t offset) const {
+        auto *bytes = static_cast<char *>(data);
+        while (num_bytes > 0) {
+            const ssize_t n = pread(fd_, bytes, num_bytes, static_cast<off_t>(offset));
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            num_bytes -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    bool DataFileReader::Open(const std::string &file_name) {
+        Close();
+        fd_ = open(file_name.c_str(), O_RDONLY);
+        if (fd_ == -1) return false;
+
+        struct stat file_stat{};
+        if (fstat(fd_, &file_stat) == -1) {
+            Close();
+            return false;
+        }
+        file_size_ = static_cast<uint64_t>(file_stat.st_size);
+
+        if (!ReadAt(&header_, sizeof(header_), 0) || header_.magic != FileHeader::kMagic ||
+            header_.version > FileHeader::kVersion ||
+            header_.header_crc != StructCrc(header_, offsetof(FileHeader, header_crc))) {
+            Close();
+            return false;
+        }
+
+        has_trailer_ = ReadTrailerIndex();
+        if (!has_trailer_ && !ScanBlocks()) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void DataFileReader::Close() {
+        if (fd_ != -1) close(fd_);
+        fd_ = -1;
+        file_size_ = 0;
+        has_trailer_ = false;
+        block_index_.clear();
+    }
+
+    bool DataFileReader::ReadTrailerIndex() {
+        if (file_size_ < header_.header_size + sizeof(FileTrailer)) return false;
+        FileTrailer trailer{};
+        if (!ReadAt(&trailer, sizeof(trailer), file_size_ - sizeof(trailer))) return false;
+        if (trailer.magic != FileTrailer::kMagic ||
+            trailer.trailer_crc != StructCrc(trailer, offsetof(FileTrailer, trailer_crc))) return false;
+
+        const uint64_t index_bytes = static_cast<uint64_t>(trailer.num_blocks) * sizeof(BlockIndexEntry);
+        if (trailer.index_offset + index_bytes + sizeof(trailer) != file_size_) return false;
+
+        block_index_.resize(trailer.num_blocks);
+        if (!ReadAt(block_index_.data(), index_bytes, trailer.index_offset) ||
+            Crc32c(block_index_.data(), index_bytes) != trailer.index_crc) {
+            block_index_.clear();
+            return false;
+        }
+        return true;
+    }
+
+    bool DataFileReader::ScanBlocks() {
+        // Walk the block headers, stop at the first one which is truncated or corrupt
+        block_index_.clear();
+        uint64_t offset = header_.header_size;
+        BlockHeader block_header{};
+        while (offset + sizeof(BlockHeader) <= file_size_) {
+            if (!ReadAt(&block_header, sizeof(block_header), offset)) break;
+            if (block_header.magic != BlockHeader::kMagic ||
+                block_header.header_crc != StructCrc(block_header, offsetof(BlockHeader, header_crc))) break;
+            if (offset + block_header.header_size + block_header.payload_bytes > file_size_) break;
+            block_index_.push_back({offset, block_header.first_event, block_header.last_event});
+            offset += block_header.header_size + block_header.payload_bytes;
+        }
+        return true;
+    }
+
+    bool DataFileReader::ReadBlock(const size_t block_num, BlockHeader &block_header, std::vector<uint32_t> &words) const {
+        if (fd_ == -1 || block_num >= block_index_.size()) return false;
+        const uint64_t offset = block_index_[block_num].offset;
+        if (!ReadAt(&block_header, sizeof(block_header), offset)) return false;
+        if (block_header.magic != BlockHeader::kMagic ||
+            block_header.header_crc != StructCrc(block_header, offsetof(BlockHeader, header_crc)) ||
+            (block_header.payload_bytes % sizeof(uint32_t)) != 0 ||
+            offset + block_header.header_size + block_header.payload_bytes > file_size_) return false;
+
+        words.resize(block_header.payload_bytes / sizeof(uint32_t));
+        if (!ReadAt(words.data(), block_header.payload_bytes, offset + block_header.header_size)) return false;
+        return Crc32c(words.data(), block_header.payload_bytes) == block_header.payload_crc;
+    }
+
+    bool DataFileReader::ReadEvents(const size_t block_num, BlockHeader &block_header, std::vector<uint32_t> &words) const {
+        if (!ReadBlock(block_num, block_header, words)) return false;
+        // Undo the compression first, it is applied after the packing
+        std::vector<uint32_t> frame;
+        if ((header_.flags & FileHeader::kFlagCompressed) && IsCompressedFrame(words.data(), words.size())) {
+            frame.swap(words);
+            if (!DecompressFrame(frame.data(), frame.size(), words)) return false;
+        }
+        if ((header_.flags & FileHeader::kFlagPacked) && IsPackedFrame(words.data(), words.size())) {
+            frame.swap(words);
+            if (!UnpackSamples(frame.data(), frame.size(), words)) return false;
+        }
+        return true;
+    }
+
+    size_t DataFileReader::FindBlock(const uint64_t event) const {
+        // Blocks are written in event order so binary search on the last event
+        size_t low = 0, high = block_index_.size();
+        while (low < high) {
+            const size_t mid = low + (high - low) / 2;
+            if (block_index_[mid].last_event < event) low = mid + 1;
+            else high = mid;
+        }
+        if (low < block_index_.size() && block_index_[low].first_event <= event) return low;
+        return block_index_.size();
+    }
+
+} // data_handler
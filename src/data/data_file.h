@@ -0,0 +1,210 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef DATA_FILE_H
+#define DATA_FILE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "file_flusher.h"
+
+namespace data_handler {
+
+/*
+ * Self-describing container for the readout data files.
+ *
+ *  [FileHeader][BlockHeader][payload]...[BlockHeader][payload][BlockIndexEntry x N][FileTrailer]
+ *
+ * Each block is one write chunk of complete events (the raw 32b words as they came off the
+ * DMA, start and end markers included) and carries its own length, event range, host time and
+ * CRC32C so it can be checked on its own. The trailer at the very end points at an index of
+ * all the blocks so a reader can seek straight to an event. If the file was not closed cleanly
+ * (no trailer) the reader falls back to walking the block headers from the start.
+ *
+ * All fields are little endian, the structs are packed by construction (naturally aligned
+ * members, sizes a multiple of 8B) and their sizes are checked below.
+ */
+
+struct FileHeader {
+    static constexpr uint32_t kMagic = 0x43505447; // "GTPC"
+    static constexpr uint16_t kVersion = 1;
+    static constexpr uint32_t kFlagCompressed = 0x1; // blocks may hold compressed frames, see compression.h
+    static constexpr uint32_t kFlagPacked = 0x2;     // blocks hold 12b packed frames, see sample_packing.h
+    static constexpr uint32_t kFlagZeroSuppressed = 0x4; // charge channels are zero suppressed, see zero_suppression.h
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint64_t run_number;
+    uint64_t subrun_number;  // file index within the run
+    uint64_t config_hash;    // FNV-1a of the run configuration json
+    int64_t start_time_ns;   // host time since epoch when the file was opened
+    uint32_t header_crc;     // CRC32C of the header up to this field
+    uint32_t flags;
+};
+
+struct BlockHeader {
+    static constexpr uint32_t kMagic = 0x4B4C4247; // "GBLK"
+
+    uint32_t magic;
+    uint32_t header_size;
+    uint64_t payload_bytes;
+    uint64_t first_event;    // event counts are 1 based and cumulative over the run
+    uint64_t last_event;
+    int64_t host_time_ns;    // host time since epoch when the block was written
+    uint32_t payload_crc;    // CRC32C of the payload
+    uint32_t header_crc;     // CRC32C of the header up to this field
+};
+
+struct BlockIndexEntry {
+    uint64_t offset;         // file offset of the block header
+    uint64_t first_event;
+    uint64_t last_event;
+};
+
+struct FileTrailer {
+    static constexpr uint32_t kMagic = 0x58444947; // "GIDX"
+
+    uint32_t magic;
+    uint32_t num_blocks;
+    uint64_t index_offset;
+    int64_t end_time_ns;
+    uint32_t index_crc;      // CRC32C of the block index entries
+    uint32_t trailer_crc;    // CRC32C of the trailer up to this field
+};
+
+static_assert(sizeof(FileHeader) == 48, "FileHeader layout changed");
+static_assert(sizeof(BlockHeader) == 48, "BlockHeader layout changed");
+static_assert(sizeof(BlockIndexEntry) == 24, "BlockIndexEntry layout changed");
+static_assert(sizeof(FileTrailer) == 32, "FileTrailer layout changed");
+
+// Stable hash for the config, std::hash is not guaranteed to be the same between builds
+uint64_t ConfigHash(const std::string &config);
+
+/*
+ * Checksum manifest written next to each data file as <file>.crc32c, one line per write
+ * chunk: "<payload offset> <payload bytes> <crc32c hex>". It covers the legacy format as well
+ * so the ground can verify any file without parsing it.
+ */
+struct ChecksumEntry {
+    uint64_t offset;
+    uint64_t num_bytes;
+    uint32_t crc;
+};
+
+constexpr char kManifestSuffix[] = ".crc32c";
+
+bool WriteManifest(const std::string &file_name, const std::vector<ChecksumEntry> &entries);
+bool ReadManifest(const std::string &file_name, std::vector<ChecksumEntry> &entries);
+
+/*
+ * Writes the container to a file descriptor. With the container disabled the payload is
+ * written as is, the legacy headerless .dat format.
+ *
+ * With a map size set each file is preallocated to that size and mapped, the blocks are then
+ * stored in the mapping instead of with write(). The caller can build the next block in place
+ * at `MappedBuffer()`, handing that pointer to `WriteBlock()` commits it without a copy. The
+ * file is cut down to its real length by `Finish()`.
+ *
+ * Not thread safe, owned by the write thread.
+ */
+class DataFileWriter {
+public:
+
+    DataFileWriter() = default;
+    ~DataFileWriter() = default;
+
+    void SetContainer(const bool use_container) { use_container_ = use_container; }
+    bool UsesContainer() const { return use_container_; }
+    void SetManifest(const bool write_manifest) { write_manifest_ = write_manifest; }
+    void SetHeaderFlags(const uint32_t flags) { header_flags_ = flags; }
+    // Report the written ranges to a background flusher, nullptr to turn it off
+    void SetFlusher(FileFlusher *flusher) { flusher_ = flusher; }
+    // Map each file of up to `map_bytes` rather than writing it, 0 to write() as usual
+    void SetMapBytes(const size_t map_bytes) { map_bytes_ = map_bytes; }
+
+    bool Open(const std::string &file_name, uint64_t run_number, uint64_t subrun_number, uint64_t config_hash);
+    // Write one block, returns the number of payload bytes written or -1 on error
+    ssize_t WriteBlock(const uint32_t *words, size_t num_words, uint64_t first_event, uint64_t last_event);
+    // Write the index, trailer and checksum manifest and hand back the fd, the caller syncs and closes it
+    int Finish();
+    bool IsOpen() const { return fd_ != -1; }
+
+    bool IsMapped() const { return map_ != nullptr; }
+    // Where the payload of the next block goes in the mapping and how many words fit
+    uint32_t *MappedBuffer() const;
+    size_t MappedCapacity() const;
+
+    // Time spent checksumming, can be read from any thread
+    uint64_t ChecksumNs() const { return checksum_ns_.load(std::memory_order_relaxed); }
+    void ResetChecksumNs() { checksum_ns_.store(0, std::memory_order_relaxed); }
+
+private:
+
+    bool WriteAll(const void *data, size_t num_bytes);
+    bool Append(const void *data, size_t num_bytes);
+    bool Unmap();
+
+    bool use_container_ = true;
+    bool write_manifest_ = true;
+    uint32_t header_flags_ = 0;
+    int fd_ = -1;
+    uint64_t offset_ = 0;
+    std::string file_name_;
+    std::vector<BlockIndexEntry> block_index_;
+    std::vector<ChecksumEntry> checksums_;
+    std::atomic<uint64_t> checksum_ns_ = 0;
+    FileFlusher *flusher_ = nullptr;
+    std::shared_ptr<FileFlusher::File> flush_file_;
+    size_t map_bytes_ = 0;
+    uint8_t *map_ = nullptr;
+};
+
+/*
+ * Reads a container file. Blocks are checked against their CRC when read.
+ */
+class DataFileReader {
+public:
+
+    DataFileReader() = default;
+    ~DataFileReader();
+
+    bool Open(const std::string &file_name);
+    void Close();
+
+    const FileHeader &Header() const { return header_; }
+    const std::vector<BlockIndexEntry> &Index() const { return block_index_; }
+    size_t NumBlocks() const { return block_index_.size(); }
+    // True if the index came from the trailer, false if it was rebuilt by scanning the file
+    bool HasTrailer() const { return has_trailer_; }
+
+    // Read block `block_num`, returns false if it is unreadable or fails its CRC
+    bool ReadBlock(size_t block_num, BlockHeader &block_header, std::vector<uint32_t> &words) const;
+    // As above but compressed and packed blocks are restored to the original event words
+    bool ReadEvents(size_t block_num, BlockHeader &block_header, std::vector<uint32_t> &words) const;
+    // Index of the block holding `event`, NumBlocks() if it is not in the file
+    size_t FindBlock(uint64_t event) const;
+
+private:
+
+    bool ReadTrailerIndex();
+    bool ScanBlocks();
+    bool ReadAt(void *data, size_t num_bytes, uint64_t offset) const;
+
+    int fd_ = -1;
+    uint64_t file_size_ = 0;
+    bool has_trailer_ = false;
+    FileHeader header_{};
+    std::vector<BlockIndexEntry> block_index_;
+};
+
+} // data_handler
+
+#endif //DATA_FILE_H
@@ -13,6 +13,7 @@
 #include <pthread.h>
 #include <sched.h>
 #include <cstdlib>
+#include <algorithm>
 
 #include "quill/LogMacros.h"
 
@@ -48,6 +49,47 @@ namespace data_handler {
         metrics["num_rw_buffer_overflow"] = num_rw_buffer_overflow_.load();
         metrics["event_start_markers"] = event_start_markers_.load();
         metrics["event_end_markers"] = event_end_markers_.load();
+        metrics["num_trigger_throttles"] = backpressure_.NumThrottles();
+        metrics["max_queue_occupancy"] = backpressure_.MaxOccupancy();
+        metrics["dead_time_ms"] = backpressure_.DeadTimeMs();
+        metrics["live_time_ms"] = backpressure_.LiveTimeMs();
+        dma_sizers_[0].AddMetrics(metrics);
+        if (per_fiber_dma_) {
+            dma_sizers_[1].AddMetrics(metrics, "dma_fiber2_");
+            for (size_t fiber = 0; fiber < kNumFibers; fiber++) {
+                const std::string prefix = "fiber" + std::to_string(fiber + 1);
+                metrics[prefix + "_dma_timeouts"] = fiber_dma_timeouts_[fiber].load();
+                metrics[prefix + "_mb"] = fiber_recv_bytes_[fiber].load() / 1000000;
+            }
+        }
+        metrics["stop_latency_ms"] = stop_latency_ms_.load();
+        fem_validator_.AddMetrics(metrics);
+        metrics["num_tapped_events"] = num_tapped_events_.load();
+        stage_timers_.AddMetrics(metrics);
+        metrics["checksum_time_ms"] = (data_file_.ChecksumNs() + striped_writer_.ChecksumNs()) / 1000000;
+        striped_writer_.AddMetrics(metrics);
+        metrics["mirror_mb"] = mirror_writer_.BytesWritten() / 1000000;
+        metrics["mirror_dropped_blocks"] = mirror_writer_.NumDropped();
+        metrics["mirror_max_queued"] = mirror_writer_.MaxQueued();
+        metrics["mirror_errors"] = mirror_writer_.NumErrors();
+        metrics["compression_in_mb"] = compression_pool_.BytesIn() / 1000000;
+        metrics["compression_out_mb"] = compression_pool_.BytesOut() / 1000000;
+        metrics["compression_failures"] = compression_pool_.NumFailed();
+        metrics["packing_in_mb"] = num_packing_in_bytes_.load() / 1000000;
+        metrics["packing_out_mb"] = num_packing_out_bytes_.load() / 1000000;
+        zero_suppression_.AddMetrics(metrics);
+        storage_manager_.AddMetrics(metrics);
+        event_builder_.AddMetrics(metrics);
+        stream_splitter_.AddMetrics(metrics);
+        pedestal_monitor_.AddMetrics(metrics);
+        occupancy_monitor_.AddMetrics(metrics);
+        downlink_selector_.AddMetrics(metrics);
+        primitive_finder_.AddMetrics(metrics);
+        loss_ledger_.AddMetrics(metrics);
+        metrics["downlink_mb"] = downlink_writer_.BytesWritten() / 1000000;
+        metrics["downlink_dropped_chunks"] = downlink_writer_.NumDropped();
+        metrics["downlink_errors"] = downlink_writer_.NumErrors();
+        file_flusher_.AddMetrics(metrics);
 
         // Since we poll the metrics every dt we can find the average rate
         prev_event_count_ = event_count_.load();
@@ -60,7 +102,7 @@ namespace data_handler {
     bool DataHandler::SetRecvBuffer(pcie_int::PCIeInterface *pcie_interface,
         pcie_int::DMABufferHandle *pbuf_rec1, pcie_int::DMABufferHandle *pbuf_rec2, bool is_data) {
 
-        static uint32_t data_32_;
+        uint32_t data_32_;
         uint32_t dev_handle = is_data ? kDev2 : kDev1;
 
         // Lock DMA buffers, they should have been unlocked
@@ -114,6 +156,34 @@ namespace data_handler {
         }
     }
 
+    void DataHandler::SetCard(const size_t card_index) {
+        card_index_ = card_index;
+        card_tag_ = card_index_ == 0 ? std::string() : "_card" + std::to_string(card_index_);
+    }
+
+    void DataHandler::SetRun(const bool set_running) {
+        // Record when the stop was requested, this starts the clock on the stop deadline
+        stop_request_ns_.store(set_running ? 0 : SteadyNowNs());
+        {
+            std::lock_guard<std::mutex> lock(run_mutex_);
+            is_running_.store(set_running);
+        }
+        run_cv_.notify_all();
+    }
+
+    bool DataHandler::SleepWhileRunning(const std::chrono::milliseconds duration) {
+        // Like sleep_for but returns early if the run is stopped
+        std::unique_lock<std::mutex> lock(run_mutex_);
+        run_cv_.wait_for(lock, duration, [this] { return !is_running_.load(); });
+        return is_running_.load();
+    }
+
+    bool DataHandler::StopDeadlinePassed() const {
+        const uint64_t stop_request = stop_request_ns_.load();
+        if (stop_request == 0) return false;
+        return (SteadyNowNs() - stop_request) >= (stop_timeout_ms_ * 1000000);
+    }
+
     uint32_t DataHandler::Configure(json &config) {
         try {
             DMABUFFSIZE = config["data_handler"]["dma_buffer_size_kb"].get<size_t>();
@@ -127,10 +197,145 @@ namespace data_handler {
             software_trig_ = trig_src == "software" ? 1 : 0;
             data_basedir_ = config["data_handler"]["data_basedir"].get<std::string>();
             file_count_.store(0);
-            write_file_name_ = data_basedir_ + "/readout_data/pGRAMS_bin_" + std::to_string(run_number_) + "_";
+            file_prefix_ = "pGRAMS_bin_" + std::to_string(run_number_) + card_tag_ + "_";
+            write_file_name_ = data_basedir_ + "/readout_data/" + file_prefix_;
             pps_sample_period_ = config["data_handler"]["pps_sample_period"].get<int>();
             read_core_id_ = config["data_handler"]["read_core_id"].get<size_t>();
             write_core_id_ = config["data_handler"]["write_core_id"].get<size_t>();
+            pin_threads_ = config["data_handler"].value("pin_threads", false);
+            // Optional, fall back to the defaults so older configs still work
+            backpressure_.Configure(config["data_handler"].value("backpressure_enable", true),
+                                    config["data_handler"].value("backpressure_high_watermark", 0.75),
+                                    config["data_handler"].value("backpressure_low_watermark", 0.25));
+            for (auto &dma_sizer : dma_sizers_) {
+                dma_sizer.Configure(config["data_handler"].value("dma_adaptive_enable", false),
+                                    config["data_handler"].value("dma_events_per_transfer", 1.0),
+                                    config["data_handler"].value("dma_min_transfer_kb", size_t{64}) * 1024,
+                                    config["data_handler"].value("dma_shrink_hold", size_t{50}));
+            }
+            per_fiber_dma_ = config["data_handler"].value("per_fiber_dma", false);
+            fiber_timeout_ms_ = config["data_handler"].value("fiber_timeout_ms", size_t{100});
+            stop_timeout_ms_ = config["data_handler"].value("stop_timeout_ms", size_t{500});
+            pulse_train_delay_ms_ = config["data_handler"].value("pulse_train_delay_ms", size_t{4000});
+            fem_validator_.SetEnable(config["data_handler"].value("validate_fem_data", true));
+            event_tap_enable_ = config["data_handler"].value("event_tap_enable", false);
+            event_tap_name_ = config["data_handler"].value("event_tap_name", std::string(kDefaultEventTapName)) + card_tag_;
+            event_tap_slots_ = config["data_handler"].value("event_tap_slots", size_t{16});
+            event_tap_prescale_ = std::max(config["data_handler"].value("event_tap_prescale", size_t{100}), size_t{1});
+            event_tap_period_ms_ = config["data_handler"].value("event_tap_period_ms", size_t{0});
+            const bool use_container = config["data_handler"].value("use_container_format", true);
+            const bool write_manifest = config["data_handler"].value("write_checksum_manifest", true);
+            data_file_.SetContainer(use_container);
+            data_file_.SetManifest(write_manifest);
+            StripePolicy stripe_policy = StripePolicy::kRoundRobin;
+            const std::string policy_name = config["data_handler"].value("output_stripe_policy", std::string("round_robin"));
+            if (!StripedWriter::ParsePolicy(policy_name, stripe_policy)) {
+                LOG_WARNING(logger_, "Unknown output stripe policy {}, using round_robin \n", policy_name);
+            }
+            striped_writer_.Configure(config["data_handler"].value("output_dirs", std::vector<std::string>()),
+                                      stripe_policy, config["data_handler"].value("output_queue_blocks", size_t{8}));
+            striped_writer_.SetContainer(use_container);
+            striped_writer_.SetManifest(write_manifest);
+            mirror_dir_ = config["data_handler"].value("mirror_dir", std::string());
+            mirror_queue_blocks_ = config["data_handler"].value("mirror_queue_blocks", size_t{16});
+            mirror_writer_.SetContainer(use_container);
+            mirror_writer_.SetManifest(write_manifest);
+            StorageManager::Policy storage_policy;
+            storage_policy.prescale = config["data_handler"].value("storage_reduced_prescale", size_t{10});
+            storage_policy.compress = config["data_handler"].value("storage_reduced_compression", true);
+            storage_policy.light_only = config["data_handler"].value("storage_reduced_light_only", false);
+            storage_manager_.Configure(config["data_handler"].value("storage_manager_enable", false),
+                                       config["data_handler"].value("storage_min_hours", 6.0),
+                                       config["data_handler"].value("storage_recover_hours", 12.0),
+                                       config["data_handler"].value("storage_check_period_s", size_t{10}),
+                                       storage_policy);
+            file_flusher_.Configure(config["data_handler"].value("sync_interval_mb", size_t{64}) * 1000000,
+                                    config["data_handler"].value("sync_interval_ms", size_t{2000}));
+            data_file_.SetFlusher(&file_flusher_);
+            mmap_writer_enable_ = config["data_handler"].value("mmap_writer_enable", false);
+            mmap_file_mb_ = config["data_handler"].value("mmap_file_mb", size_t{4000});
+            striped_writer_.SetFlusher(&file_flusher_);
+            striped_writer_.SetLossLedger(&loss_ledger_);
+            mirror_writer_.SetFlusher(&file_flusher_);
+            storage_manager_.ClearVolumes();
+            const auto output_dirs = config["data_handler"].value("output_dirs", std::vector<std::string>());
+            storage_manager_.AddVolume(output_dirs.empty() ? std::vector<std::string>{data_basedir_ + "/readout_data"} : output_dirs);
+            if (!mirror_dir_.empty()) storage_manager_.AddVolume({mirror_dir_});
+            compression_enable_ = config["data_handler"].value("compression_enable", false);
+            compression_level_ = config["data_handler"].value("compression_level", 1);
+            compression_threads_ = config["data_handler"].value("compression_threads", size_t{2});
+            compression_max_in_flight_ = config["data_handler"].value("compression_max_in_flight", size_t{4});
+            bit_packing_enable_ = config["data_handler"].value("bit_packing_enable", false);
+            charge_first_module_ = config["crate"].value("charge_fem_slot", 0u);
+            charge_last_module_ = config["crate"].value("last_charge_slot", 31u);
+            // Every charge FEM and the light FEM are expected in a built event
+            uint32_t expected_modules = 0;
+            for (uint32_t module = charge_first_module_; module <= charge_last_module_ && module < 32; module++) {
+                expected_modules |= 1u << module;
+            }
+            const int light_module = config["crate"].value("light_fem_slot", -1);
+            const uint32_t light_mask = (light_module >= 0 && light_module < 32) ? 1u << light_module : 0;
+            expected_modules |= light_mask;
+            // The records of the two fibers are only merged by the event builder
+            event_builder_.Configure(config["data_handler"].value("event_builder_enable", false) || per_fiber_dma_,
+                                     expected_modules,
+                                     config["data_handler"].value("eb_window", size_t{16}),
+                                     config["data_handler"].value("eb_timeout_ms", size_t{1000}));
+            stream_splitter_.Configure(config["data_handler"].value("split_light_stream", false), light_mask,
+                                       config["data_handler"].value("light_queue_blocks", size_t{16}));
+            stream_splitter_.SetContainer(use_container);
+            stream_splitter_.SetManifest(write_manifest);
+            stream_splitter_.SetFlusher(&file_flusher_);
+            light_dir_ = config["data_handler"].value("light_stream_dir", data_basedir_ + "/readout_data");
+            if (stream_splitter_.IsEnabled() && light_mask == 0) {
+                LOG_WARNING(logger_, "No light FEM slot configured, the light stream will be empty \n");
+            }
+            if (stream_splitter_.IsEnabled()) storage_manager_.AddVolume({light_dir_});
+            occupancy_monitor_.Configure(config["data_handler"].value("occupancy_monitor_enable", false),
+                                         config["data_handler"].value("occupancy_prescale", size_t{10}),
+                                         config["data_handler"].value("occupancy_threshold", 20u),
+                                         config["data_handler"].value("occupancy_period_ms", size_t{1000}),
+                                         config["data_handler"].value("occupancy_noisy_factor", 5.0),
+                                         expected_modules, light_mask);
+            downlink_enable_ = config["data_handler"].value("downlink_enable", false);
+            downlink_dir_ = config["data_handler"].value("downlink_dir", data_basedir_ + "/readout_data");
+            downlink_queue_blocks_ = config["data_handler"].value("downlink_queue_blocks", size_t{8});
+            downlink_selector_.Configure(config["data_handler"].value("downlink_prescale", size_t{100}),
+                                         config["data_handler"].value("downlink_random_fraction", 0.0),
+                                         config["data_handler"].value("downlink_budget_kb", size_t{1000}) * 1000);
+            downlink_writer_.SetContainer(use_container);
+            downlink_writer_.SetManifest(write_manifest);
+            downlink_writer_.SetFlusher(&file_flusher_);
+            if (downlink_enable_) storage_manager_.AddVolume({downlink_dir_});
+            primitive_finder_.Configure(config["data_handler"].value("tp_finder_enable", false),
+                                        config["data_handler"].value("tp_threshold", 20u),
+                                        config["data_handler"].value("tp_min_tot", size_t{2}),
+                                        config["data_handler"].value("tp_baseline_samples", size_t{16}),
+                                        config["data_handler"].value("tp_waveform_prescale", size_t{0}),
+                                        charge_first_module_, charge_last_module_,
+                                        config["data_handler"].value("tp_queue_blocks", size_t{16}));
+            primitive_finder_.SetContainer(use_container);
+            primitive_finder_.SetManifest(write_manifest);
+            primitive_finder_.SetFlusher(&file_flusher_);
+            tp_dir_ = config["data_handler"].value("tp_dir", data_basedir_ + "/readout_data");
+            if (primitive_finder_.IsEnabled()) storage_manager_.AddVolume({tp_dir_});
+            zero_suppression_.Configure(config["data_handler"].value("zero_suppression_enable", false),
+                                        config["data_handler"].value("zs_threshold", 10u),
+                                        config["data_handler"].value("zs_pre_samples", size_t{8}),
+                                        config["data_handler"].value("zs_post_samples", size_t{16}),
+                                        config["data_handler"].value("zs_baseline_samples", size_t{16}),
+                                        charge_first_module_, charge_last_module_);
+            const std::string pedestal_file = config["data_handler"].value("zs_pedestal_file", std::string());
+            if (zero_suppression_.IsEnabled() && !pedestal_file.empty() && !zero_suppression_.LoadPedestals(pedestal_file)) {
+                LOG_WARNING(logger_, "Failed to load pedestals from {}, estimating baselines per event \n", pedestal_file);
+            }
+            pedestal_monitor_.Configure(config["data_handler"].value("pedestal_monitor_enable", false),
+                                        config["data_handler"].value("pedestal_prescale", size_t{100}),
+                                        config["data_handler"].value("pedestal_samples", size_t{32}),
+                                        config["data_handler"].value("pedestal_snapshot_s", size_t{60}),
+                                        charge_first_module_, charge_last_module_,
+                                        config["data_handler"].value("pedestal_snapshot_file", std::string()));
+            config_hash_ = ConfigHash(config.dump());
             LOG_INFO(logger_, "Trigger source software [{}] external [{}] \n", software_trig_, ext_trig_);
             LOG_DEBUG(logger_, "\t [{}] DMA loops with [{}] 32b words \n", num_dma_loops_, DATABUFFSIZE / 4);
             LOG_INFO(logger_, "\n Writing files: {}", write_file_name_);
@@ -146,16 +351,37 @@ namespace data_handler {
         }
         DMABUFFSIZE *= 1000; // convert to bytes
 
+        // The tap lives across runs so the monitor only has to attach once
+        if (event_tap_enable_ && !event_tap_.IsOpen()) {
+            if (event_tap_.Open(event_tap_name_, event_tap_slots_, DATABUFFSIZE)) {
+                LOG_INFO(logger_, "Opened event tap {} with {} slots \n", event_tap_name_, event_tap_slots_);
+            } else {
+                LOG_WARNING(logger_, "Failed to open event tap {} with error {} \n", event_tap_name_, std::string(strerror(errno)));
+            }
+        } else if (!event_tap_enable_ && event_tap_.IsOpen()) {
+            event_tap_.Close();
+        }
+
         return 0x0;
     }
 
     bool DataHandler::SwitchWriteFile() {
 
-        // Make sure we copy `fd_` so when we re-assign it later it doesn't affect the thread.
+        WriteLossSummary();
+        std::string name;
+        if (striped_writer_.IsRunning()) {
+            // The directory writer thread finishes and closes the old file on its own
+            file_count_ += 1;
+            if (!OpenDataFile(name)) return false;
+            LOG_INFO(logger_, "Switched to file: {}\n", name);
+            return true;
+        }
+
+        // Write the file trailer and take the fd so re-opening later doesn't affect the thread.
         // Start a thread and detach it so the file closes in the background at its leisure
         // while we continue to write data to the newly opened file.
-        int fd_copy = fd_;
-        std::thread close_thread([&fd_copy, this]() {
+        int fd_copy = data_file_.Finish();
+        std::thread close_thread([fd_copy, this]() {
             LOG_DEBUG(logger_, "Closing data file {} \n", fd_copy);
             if(close(fd_copy) == -1) {
                 LOG_ERROR(logger_, "Failed to close data file, with error:{} \n", std::string(strerror(errno)));
@@ -164,31 +390,106 @@ namespace data_handler {
         close_thread.detach();
 
         file_count_ += 1;
-        std::string name = write_file_name_  + std::to_string(file_count_.load()) + ".dat";
+        if (!OpenDataFile(name)) return false;
 
-        fd_ = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd_ == -1) {
+        LOG_INFO(logger_, "Switched to file: {}\n", name);
+        return true;
+    }
+
+    bool DataHandler::OpenDataFile(std::string &name) {
+        const std::string file_name = file_prefix_ + std::to_string(file_count_.load()) + ".dat";
+        events_in_file_ = 0;
+        // The mirror writer closes its previous file itself
+        if (mirror_writer_.IsRunning()) {
+            mirror_writer_.Open(mirror_dir_ + "/" + file_name, run_number_, file_count_.load(), config_hash_);
+        }
+        if (downlink_writer_.IsRunning()) {
+            downlink_selector_.NewFile();
+            downlink_writer_.Open(downlink_dir_ + "/pGRAMS_downlink_" + std::to_string(run_number_) + card_tag_ + "_" +
+                                  std::to_string(file_count_.load()) + ".dat",
+                                  run_number_, file_count_.load(), config_hash_);
+        }
+        if (primitive_finder_.IsRunning()) {
+            primitive_finder_.OpenFile(tp_dir_ + "/pGRAMS_tp_" + std::to_string(run_number_) + card_tag_ + "_" +
+                                       std::to_string(file_count_.load()) + ".dat",
+                                       run_number_, file_count_.load(), config_hash_);
+        }
+        // The light file shares the subrun number of its charge file
+        if (stream_splitter_.IsRunning()) {
+            stream_splitter_.OpenFile(light_dir_ + "/pGRAMS_light_" + std::to_string(run_number_) + card_tag_ + "_" +
+                                      std::to_string(file_count_.load()) + ".dat",
+                                      run_number_, file_count_.load(), config_hash_);
+        }
+        if (striped_writer_.IsRunning()) {
+            name = striped_writer_.OpenFile(file_name, run_number_, file_count_.load(), config_hash_);
+            ReportFailedDirectories();
+            current_file_name_ = name;
+            if (name.empty()) {
+                LOG_ERROR(logger_, "No output directory left to open {} \n", file_name);
+                return false;
+            }
+            return true;
+        }
+        name = write_file_name_ + std::to_string(file_count_.load()) + ".dat";
+        current_file_name_ = name;
+        if (!data_file_.Open(name, run_number_, file_count_.load(), config_hash_)) {
             LOG_ERROR(logger_, "Failed to open file {} with error {} aborting run! \n", name, std::string(strerror(errno)));
             return false;
         }
-
-        LOG_INFO(logger_, "Switched to file: {} fd={}\n", name, fd_);
         return true;
     }
 
+    void DataHandler::WriteLossSummary() {
+        if (current_file_name_.empty()) return;
+        if (!loss_ledger_.WriteFileSummary(current_file_name_, run_number_, file_count_.load())) {
+            LOG_WARNING(logger_, "Failed to write the loss summary of {} \n", current_file_name_);
+        }
+        loss_ledger_.BeginFile();
+    }
+
+    void DataHandler::ReportFailedDirectories() {
+        for (const auto &directory : striped_writer_.TakeFailedDirectories()) {
+            LOG_ERROR(logger_, "Output directory {} is missing, not writable or failed to open a file, "
+                               "left out of the striping \n", directory);
+        }
+    }
+
+    ssize_t DataHandler::WriteDataBlock(const uint32_t *words, const size_t num_words,
+                                        const uint64_t first_event, const uint64_t last_event) {
+        // Never wait on the mirror, if its queue is full the block is only dropped from the copy
+        if (mirror_writer_.IsRunning()) mirror_writer_.Write(words, num_words, first_event, last_event, false);
+        if (striped_writer_.IsRunning()) {
+            const ssize_t num_bytes = striped_writer_.WriteBlock(words, num_words, first_event, last_event);
+            ReportFailedDirectories();
+            return num_bytes;
+        }
+        return data_file_.WriteBlock(words, num_words, first_event, last_event);
+    }
+
     void DataHandler::CollectData(pcie_int::PCIeInterface *pcie_interface) {
 
+        stage_timers_.Reset();
+
         auto write_thread = std::thread(&DataHandler::DataWrite, this);
         //auto write_thread = std::thread(&DataHandler::FastDataWrite, this);
         auto read_thread = std::thread(&DataHandler::ReadoutDMARead, this, pcie_interface);
 
-        // Pin these threads to the specified core
-        // PinThread(read_thread, read_core_id_);
-        // PinThread(write_thread, write_core_id_);
+        // Pin these threads to the specified core, each card pair has its own cores
+        if (pin_threads_) {
+            PinThread(read_thread, read_core_id_);
+            PinThread(write_thread, write_core_id_);
+        }
 
         // auto read_thread = std::thread(&DataHandler::ReadoutViaController, this, pcie_interface, buffers);
-        auto trig_pps = std::thread(&DataHandler::PollTriggerPPS, this, pcie_interface);
-        auto trigger_thread = std::thread(&DataHandler::TriggerDMARead, this, pcie_interface);
+        // The trigger, PPS and pulse train are only handled by the card pair which owns the trigger
+        std::thread trig_pps;
+        std::thread trigger_thread;
+        if (IsTriggerOwner()) {
+            num_pause_requests_.store(0);
+            trigger_interface_.store(pcie_interface);
+            trig_pps = std::thread(&DataHandler::PollTriggerPPS, this, pcie_interface);
+            trigger_thread = std::thread(&DataHandler::TriggerDMARead, this, pcie_interface);
+        }
 
         // auto trigger_thread = std::thread(&trig_ctrl::TriggerControl::SendSoftwareTrigger, &trigger_,
         //     pcie_interface, software_trigger_rate_, trigger_module_);
@@ -200,16 +501,13 @@ namespace data_handler {
         //auto trigger_thread = std::thread(&DataHandler::TriggerDMARead, this, pcie_interface);
         LOG_INFO(logger_, "Started read and write threads... \n");
 
-        // Wait 1s and send the start of run marker "Pulse Train"
-        std::this_thread::sleep_for(std::chrono::seconds(4));
-        int ret = std::system("ad3_ctrl 3");
-        if (ret != 0) {
-            LOG_ERROR(logger_, "Pulse train send error, return value: {} \n", ret);
-        }
-        LOG_INFO(logger_, "Sent pulse train... \n");
+        // Send the start of run marker "Pulse Train" once the readout has settled, this is done
+        // in its own thread so a short run is not held up waiting for it.
+        std::thread pulse_train_thread;
+        if (IsTriggerOwner()) pulse_train_thread = std::thread(&DataHandler::SendPulseTrain, this);
 
         // Shut down PPS polling thread
-        trig_pps.join();
+        if (trig_pps.joinable()) trig_pps.join();
 
         // Shut down the write thread first so we're not trying to access buffer ptrs
         // after they have been deleted in the read thread
@@ -220,9 +518,28 @@ namespace data_handler {
         LOG_DEBUG(logger_, "read thread joined... \n");
 
         // The read/write threads will block until a run stop is set. Then we stop the trigger.
-        trigger_thread.join();
+        if (trigger_thread.joinable()) trigger_thread.join();
         LOG_DEBUG(logger_, "trigger thread joined... \n");
+        if (pulse_train_thread.joinable()) pulse_train_thread.join();
         LOG_INFO(logger_, "Read, Write and Trigger threads joined... \n");
+
+        const uint64_t stop_request = stop_request_ns_.load();
+        if (stop_request > 0) {
+            stop_latency_ms_.store((SteadyNowNs() - stop_request) / 1000000);
+            LOG_INFO(logger_, "Run stopped in [{}]ms (deadline {}ms) \n", stop_latency_ms_.load(), stop_timeout_ms_);
+        }
+    }
+
+    void DataHandler::SendPulseTrain() {
+        if (!SleepWhileRunning(std::chrono::milliseconds(pulse_train_delay_ms_))) {
+            LOG_INFO(logger_, "Run stopped before the pulse train was sent \n");
+            return;
+        }
+        int ret = std::system("ad3_ctrl 3");
+        if (ret != 0) {
+            LOG_ERROR(logger_, "Pulse train send error, return value: {} \n", ret);
+        }
+        LOG_INFO(logger_, "Sent pulse train... \n");
     }
 
     void DataHandler::FastDataWrite() {
@@ -235,17 +552,17 @@ namespace data_handler {
             LOG_ERROR(logger_, "Failed to open file {} with error {} aborting run! \n", name, std::string(strerror(errno)));
         }
 
-        std::array<uint32_t, DATABUFFSIZE> word_arr{};
+        DmaBlock word_arr{};
         while (!stop_write_.load()) {
             while (data_queue_.read(word_arr)) {
-                write(fd_, word_arr.data(), word_arr.size()*sizeof(uint32_t));
+                write(fd_, word_arr.words.data(), word_arr.num_words*sizeof(uint32_t));
             } // read buffer loop
         } // run loop
 
         // Write any remaining full events in the buffer to file before closing
         while (!data_queue_.isEmpty()) {
             data_queue_.read(word_arr);
-            write(fd_, word_arr.data(), word_arr.size()*sizeof(uint32_t));
+            write(fd_, word_arr.words.data(), word_arr.num_words*sizeof(uint32_t));
         }
 
         LOG_INFO(logger_, "Ended data write and closing file..\n");
@@ -261,92 +578,507 @@ namespace data_handler {
     void DataHandler::DataWrite() {
         LOG_INFO(logger_, "Read thread start! \n");
 
-        std::string name = write_file_name_  + std::to_string(file_count_.load()) + ".dat";
-        // 0644 user, group and others read/write permissions
-        fd_ = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd_ == -1) {
-            LOG_ERROR(logger_, "Failed to open file {} with error {} aborting run! \n", name, std::string(strerror(errno)));
+        compression_pool_.ResetCounters();
+        // The pool is also started if the reduced data mode may turn compression on later
+        const bool may_compress = compression_enable_ ||
+                                  (storage_manager_.IsEnabled() && storage_manager_.ReducedPolicy().compress);
+        if (may_compress &&
+            !compression_pool_.Start(compression_threads_, Codec::kZstd, compression_level_, compression_max_in_flight_)) {
+            LOG_WARNING(logger_, "Compression not available in this build, writing raw data \n");
+        }
+        const uint32_t header_flags = (compression_pool_.IsRunning() ? FileHeader::kFlagCompressed : 0) |
+                                      (bit_packing_enable_ ? FileHeader::kFlagPacked : 0) |
+                                      (zero_suppression_.IsEnabled() ? FileHeader::kFlagZeroSuppressed : 0);
+        data_file_.SetHeaderFlags(header_flags);
+        striped_writer_.SetHeaderFlags(header_flags);
+        mirror_writer_.SetHeaderFlags(header_flags);
+        mirror_writer_.ResetCounters();
+        file_flusher_.ResetCounters();
+        file_flusher_.Start();
+        if (!mirror_dir_.empty()) mirror_writer_.Start(mirror_queue_blocks_);
+        // The light data is written raw, it is never packed, suppressed or compressed
+        stream_splitter_.SetHeaderFlags(0);
+        if (stream_splitter_.IsEnabled()) stream_splitter_.Start();
+        // The downlink gets the events as they were read out, before any reduction
+        downlink_writer_.SetHeaderFlags(0);
+        downlink_writer_.ResetCounters();
+        downlink_selector_.Reset();
+        if (downlink_enable_) downlink_writer_.Start(downlink_queue_blocks_);
+        if (primitive_finder_.IsEnabled()) primitive_finder_.Start();
+        if (striped_writer_.IsEnabled()) {
+            const std::string index_file = write_file_name_ + "files.txt";
+            const bool index_open = striped_writer_.Start(index_file);
+            ReportFailedDirectories();
+            if (!striped_writer_.IsRunning()) {
+                LOG_ERROR(logger_, "No usable output directory, writing to {} instead \n", write_file_name_);
+            } else if (!index_open) {
+                LOG_WARNING(logger_, "Failed to open file index {} \n", index_file);
+            }
         }
+        num_packing_in_bytes_.store(0);
+        num_packing_out_bytes_.store(0);
+        std::vector<uint32_t> packed_chunk;
+
+        // The chunk is transformed before it is written when packing or compressing, so it can't
+        // be built in the file mapping
+        const bool use_mmap = mmap_writer_enable_ && !bit_packing_enable_ && !compression_pool_.IsRunning() &&
+                              !striped_writer_.IsRunning();
+        if (mmap_writer_enable_ && !use_mmap) {
+            LOG_WARNING(logger_, "Memory mapped writer not used with packing, compression or striping \n");
+        }
+        data_file_.SetMapBytes(use_mmap ? mmap_file_mb_ * 1000000 : 0);
+
+        std::string name;
+        current_file_name_.clear();
+        OpenDataFile(name);
 
         uint32_t word;
-        std::array<uint32_t, DATABUFFSIZE> word_arr{};
+        DmaBlock word_arr{};
         // auto word_arr = std::make_unique<std::array<uint32_t, DATABUFFSIZE>>();
-        // Construct event buffer on the heap so we don't stack overflow (Linux process default stack limit is ~8MB)
-        auto  word_arr_write = std::make_unique<std::array<uint32_t, EVENTBUFFSIZE>>();
+        // Construct event buffer on the heap so we don't stack overflow (Linux process default stack limit is ~8MB).
+        // Not needed when the events are built in the mapped file.
+        std::unique_ptr<std::array<uint32_t, EVENTBUFFSIZE>> word_arr_write;
         bool event_start = false;
         size_t num_words = 0;
         size_t event_words = 0;
+        size_t event_begin = 0;
         size_t event_chunk = 0;
         size_t event_start_count = 0;
         size_t event_end_count = 0;
         size_t num_recv_bytes = 0;
         size_t local_event_count = 0;
+        // Event range of the chunk being built, events can be skipped in the reduced data mode
+        uint64_t chunk_first_event = 0;
+        uint64_t chunk_last_event = 0;
         event_count_.store(0);
         event_start_markers_.store(0);
         event_end_markers_.store(0);
+        fem_validator_.Reset();
+        zero_suppression_.Reset();
+        storage_manager_.Reset();
+        event_builder_.Reset();
+        pedestal_monitor_.Reset();
+        occupancy_monitor_.Reset();
+        loss_ledger_.Reset();
+        EventBuilder::BuiltEvent built_event;
+        data_file_.ResetChecksumNs();
+        num_tapped_events_.store(0);
+        auto last_tap_time = std::chrono::steady_clock::now();
+        const auto tap_period = std::chrono::milliseconds(event_tap_period_ms_);
+        using Stage = PipelineTimers::Stage;
 
         // Dereferencing the pointer in the loop is slow so dereference once before 
         // the loop and use the copy of the raw pointer
-        uint32_t *event_buffer_ptr = word_arr_write->data();
-        size_t event_buffer_size = word_arr_write->size();
+        uint32_t *event_buffer_ptr = nullptr;
+        size_t event_buffer_size = 0;
+
+        // Point the event buffer at the next block in the mapped file, or the heap buffer. Called
+        // whenever a chunk has been written as the next block starts behind it.
+        auto set_event_buffer = [&]() {
+            if (data_file_.IsMapped()) {
+                event_buffer_ptr = data_file_.MappedBuffer();
+                event_buffer_size = std::min(EVENTBUFFSIZE, data_file_.MappedCapacity());
+                return;
+            }
+            if (!word_arr_write) word_arr_write = std::make_unique<std::array<uint32_t, EVENTBUFFSIZE>>();
+            event_buffer_ptr = word_arr_write->data();
+            event_buffer_size = word_arr_write->size();
+        };
+        set_event_buffer();
+
+        auto write_block = [&](const uint32_t *words, const size_t block_words, const uint64_t first_event,
+                               const uint64_t last_event) {
+            const uint64_t write_start = PipelineTimers::NowNs();
+            const ssize_t write_bytes = WriteDataBlock(words, block_words, first_event, last_event);
+            stage_timers_.Record(Stage::kWrite, PipelineTimers::NowNs() - write_start);
+            if (write_bytes == -1) {
+                LOG_WARNING(logger_, "Failed write {} \n", std::string(strerror(errno)));
+                loss_ledger_.Record(LossReason::kWriteFailed, last_event - first_event + 1);
+            } else num_recv_bytes += static_cast<size_t>(write_bytes);
+        };
+
+        // Write the oldest compressed chunk if it is done (or wait for it), false if there was none.
+        // The frames come back in submission order so the blocks stay in event order.
+        auto write_compressed = [&](const bool wait) {
+            auto job = compression_pool_.NextDone(wait);
+            if (!job) return false;
+            const std::vector<uint32_t> &block = job->compressed ? job->frame : job->words;
+            write_block(block.data(), block.size(), job->first_event, job->last_event);
+            compression_pool_.RecycleJob(std::move(job));
+            return true;
+        };
+
+        // Never wait on the downlink, the events of a block it has no room for are left out
+        std::vector<uint32_t> downlink_block;
+        auto write_downlink = [&]() {
+            if (!downlink_writer_.IsRunning()) return;
+            uint64_t first_event = 0;
+            uint64_t last_event = 0;
+            const size_t num_events = downlink_selector_.TakeBlock(downlink_block, first_event, last_event);
+            if (num_events == 0) return;
+            if (!downlink_writer_.Write(downlink_block.data(), downlink_block.size(), first_event, last_event, false)) {
+                loss_ledger_.Record(LossReason::kDownlinkFull, num_events);
+            }
+        };
+
+        // Write the complete events at the start of the event buffer, directly or through the compression pool
+        auto write_chunk = [&](size_t chunk_words) {
+            const uint64_t first_event = chunk_first_event;
+            const uint64_t last_event = chunk_last_event;
+            const uint32_t *chunk = event_buffer_ptr;
+            if (stream_splitter_.IsRunning()) stream_splitter_.WriteChunk(first_event, last_event);
+            if (primitive_finder_.IsRunning()) primitive_finder_.WriteBlock();
+            write_downlink();
+            if (bit_packing_enable_) {
+                PackSamples(event_buffer_ptr, chunk_words, packed_chunk);
+                num_packing_in_bytes_ += chunk_words * sizeof(uint32_t);
+                num_packing_out_bytes_ += packed_chunk.size() * sizeof(uint32_t);
+                chunk = packed_chunk.data();
+                chunk_words = packed_chunk.size();
+            }
+            if (!compression_pool_.IsRunning() || !(compression_enable_ || storage_manager_.CompressReduced())) {
+                // Anything still in the pool goes first to keep the blocks in order
+                while (write_compressed(true)) {}
+                write_block(chunk, chunk_words, first_event, last_event);
+                return;
+            }
+            // Push back on the event scan if the workers can't keep up
+            while (compression_pool_.IsFull()) write_compressed(true);
+            auto job = compression_pool_.AcquireJob();
+            job->words.assign(chunk, chunk + chunk_words);
+            job->first_event = first_event;
+            job->last_event = last_event;
+            compression_pool_.Submit(std::move(job));
+            while (write_compressed(false)) {}
+        };
+
+        uint64_t write_ns = 0;
+
+        // Write the chunk of EVENTCHUNK events and switch files when it's time
+        auto write_full_chunk = [&]() {
+            if ((local_event_count % 50) == 0) LOG_INFO(logger_, " **** Event: {} \n", local_event_count);
+            const uint64_t write_start = PipelineTimers::NowNs();
+            write_chunk(num_words);
+            events_in_file_ += event_chunk;
+            if (storage_manager_.Update(num_recv_bytes)) {
+                LOG_WARNING(logger_, "Data volumes full in {:.1f}h, {} the reduced data mode \n",
+                            storage_manager_.HoursToFull(), storage_manager_.IsReduced() ? "entering" : "leaving");
+            }
 
-        while (!stop_write_.load()) {
-            while (data_queue_.read(word_arr)) {
-                for (size_t i = 0; i < (DMABUFFSIZE / 4); i++) {
-                    word = word_arr[i];
-                    if (num_words >= event_buffer_size) {
-                        LOG_WARNING(logger_, "Unexpectedly large event, dropping it! num_words=[{}] > event buffer size=[{}] \n",
-                                    num_words, EVENTBUFFSIZE);
-                        num_words = 0;
-                        event_start = false;
+            // A mapped file is switched early if the next chunk might not fit
+            const bool file_full = data_file_.IsMapped() && data_file_.MappedCapacity() < EVENTBUFFSIZE;
+            if (events_in_file_ >= EVENTSPERFILE || file_full) {
+                // Flush the compression pool so the chunks end up in the right file
+                while (write_compressed(true)) {}
+                SwitchWriteFile();
+            }
+            set_event_buffer();
+            write_ns += PipelineTimers::NowNs() - write_start;
+            num_recv_mB_.store(num_recv_bytes / 1000000);
+            // Chunks can be written short, average over the events actually in it
+            num_event_chunk_words_.store(num_words / std::max(event_chunk, size_t{1}));
+            event_start = false; num_words = 0; event_words = 0; event_chunk = 0;
+        };
+
+        // The event from `event_begin` (its start marker) to `num_words` is complete, reduce it,
+        // close it with the end marker and write the chunk once it is full
+        auto finish_event = [&]() {
+            local_event_count++;
+            event_count_.store(local_event_count);
+            // The downlink summarises every event and samples them whole, before anything is dropped or reduced
+            if (downlink_writer_.IsRunning()) {
+                downlink_selector_.AddEvent(event_buffer_ptr + event_begin + 1, num_words - event_begin - 1,
+                                            local_event_count);
+            }
+            // Sampled before the zero suppression so the monitors see the full waveforms
+            pedestal_monitor_.SampleEvent(event_buffer_ptr + event_begin + 1, num_words - event_begin - 1,
+                                          local_event_count);
+            occupancy_monitor_.SampleEvent(event_buffer_ptr + event_begin + 1, num_words - event_begin - 1,
+                                           local_event_count);
+            if (primitive_finder_.IsRunning()) {
+                primitive_finder_.FindEvent(event_buffer_ptr + event_begin + 1, num_words - event_begin - 1,
+                                            local_event_count);
+                // Most events can be kept as their primitives only
+                if (!primitive_finder_.KeepWaveforms()) {
+                    loss_ledger_.Record(LossReason::kWaveformPrescale);
+                    num_words = event_begin;
+                    return;
+                }
+            }
+            // In the reduced data mode only every Nth event is kept, of those which kept their
+            // waveforms, so with both prescales 1/(N*M) of the events are written in full
+            if (!storage_manager_.KeepEvent()) {
+                storage_manager_.CountPrescaled();
+                loss_ledger_.Record(LossReason::kStoragePrescale);
+                num_words = event_begin;
+                return;
+            }
+            loss_ledger_.CountWritten();
+            if (storage_manager_.LightOnlyReduced()) {
+                num_words = event_begin + 1 + FemDataValidator::RemoveModules(event_buffer_ptr + event_begin + 1,
+                                                                            num_words - event_begin - 1,
+                                                                            charge_first_module_, charge_last_module_);
+            }
+            if (zero_suppression_.IsEnabled()) {
+                num_words = event_begin + 1 + zero_suppression_.SuppressEvent(event_buffer_ptr + event_begin + 1,
+                                                                             num_words - event_begin - 1);
+            }
+            if (event_chunk == 0) chunk_first_event = local_event_count;
+            chunk_last_event = local_event_count;
+            event_chunk++;
+            event_buffer_ptr[num_words++] = kEventEndWord;
+            event_words = num_words;
+
+            // Sample complete events into the monitor tap
+            if (event_tap_.IsOpen()) {
+                const auto now = std::chrono::steady_clock::now();
+                if ((local_event_count % event_tap_prescale_) == 0 ||
+                    (event_tap_period_ms_ > 0 && (now - last_tap_time) >= tap_period)) {
+                    if (event_tap_.Publish(event_buffer_ptr + event_begin, num_words - event_begin, local_event_count)) {
+                        num_tapped_events_++;
                     }
-                    if (isEventStart(word)) {
-                        if (event_start) num_words = 0; // Previous evt didn't finish, drop partial evt data
-                        event_start = true; event_start_count++;
-                        event_start_markers_++;
+                    last_tap_time = now;
+                }
+            }
+            // The tap still sees the whole event, only the charge data stays in the main stream
+            if (stream_splitter_.IsRunning()) {
+                num_words = event_begin + 1 + stream_splitter_.SplitEvent(event_buffer_ptr + event_begin + 1,
+                                                                          num_words - event_begin - 2);
+                event_buffer_ptr[num_words++] = kEventEndWord;
+                event_words = num_words;
+            }
+            if (event_chunk == EVENTCHUNK) write_full_chunk();
+        };
+
+        // Copy the events the builder has finished into the event buffer
+        auto place_built_events = [&](const bool flush) {
+            while (event_builder_.NextEvent(built_event, PipelineTimers::NowNs(), flush)) {
+                const size_t event_size = 2 + EventBuilder::kHeaderWords + built_event.words.size();
+                if (num_words + event_size > event_buffer_size && event_chunk > 0) {
+                    // Write out what we have to make room, the short chunk counts towards the
+                    // file by its events so the file switching is unaffected
+                    num_words = event_words;
+                    write_full_chunk();
+                }
+                if (num_words + event_size > event_buffer_size) {
+                    LOG_WARNING(logger_, "Unexpectedly large built event, dropping it! num_words=[{}] > event buffer size=[{}] \n",
+                                event_size, event_buffer_size);
+                    loss_ledger_.Record(LossReason::kOversizeBuiltEvent);
+                    continue;
+                }
+                if (!(built_event.status & EventBuilder::kStatusComplete)) {
+                    loss_ledger_.Record(LossReason::kIncompleteEvent);
+                }
+                event_begin = num_words;
+                event_buffer_ptr[num_words++] = kEventStartWord;
+                EventBuilder::EncodeHeader(built_event, event_buffer_ptr + num_words);
+                num_words += EventBuilder::kHeaderWords;
+                std::copy(built_event.words.begin(), built_event.words.end(), event_buffer_ptr + num_words);
+                num_words += built_event.words.size();
+                finish_event();
+            }
+        };
+
+        // Follow the FEM event number of the first FEM in a record, so events which never got
+        // this far show up as gaps
+        auto observe_record = [&](const uint32_t *words, const size_t begin, const size_t end) {
+            const size_t header_idx = FemDataValidator::FindNextHeader(words, begin, end);
+            if (header_idx + FemDataValidator::kHeaderWords > end) return;
+            loss_ledger_.ObserveEvent(FemDataValidator::DecodeHeader(words + header_idx).event_number);
+        };
+        auto observe_event = [&]() { observe_record(event_buffer_ptr, event_begin + 1, num_words); };
+
+        // Split the DMA buffer words into events and write them to file in chunks of EVENTCHUNK
+        auto process_buffer = [&]() {
+            const uint64_t scan_start = PipelineTimers::NowNs();
+            write_ns = 0;
+            for (size_t i = 0; i < word_arr.num_words; i++) {
+                word = word_arr.words[i];
+                if (num_words >= event_buffer_size) {
+                    LOG_WARNING(logger_, "Unexpectedly large event, dropping it! num_words=[{}] > event buffer size=[{}] \n",
+                                num_words, EVENTBUFFSIZE);
+                    if (event_start) observe_event();
+                    loss_ledger_.Record(LossReason::kOversizeEvent);
+                    if (event_chunk > 0) {
+                        // Only the partial event is dropped, the complete ones before it are written
+                        // as a short chunk, the file switching counts them by event
+                        num_words = event_words;
+                        write_full_chunk();
                     }
-                    else if (isEventEnd(word) && event_start) {
-                        event_end_count++; event_start = false;
-                        event_end_markers_++;
-                        event_chunk++;
-                        local_event_count++;
-                        event_count_.store(local_event_count);
-                        event_words = num_words + 1; // add one for event end word
+                    num_words = 0;
+                    event_start = false;
+                }
+                if (isEventStart(word)) {
+                    if (event_start) {
+                        // Previous evt didn't finish, drop the partial evt data
+                        observe_event();
+                        loss_ledger_.Record(LossReason::kTruncatedEvent);
+                        num_words = event_begin;
                     }
-                    event_buffer_ptr[num_words] = word;
-                    num_words++;
-                    // num_recv_bytes += 4;
-                    if (event_chunk == EVENTCHUNK) {
-                        if ((local_event_count % 50) == 0) LOG_INFO(logger_, " **** Event: {} \n", local_event_count);
-                        const int write_bytes = write(fd_, event_buffer_ptr, num_words*sizeof(uint32_t));
-                        if (write_bytes == -1) LOG_WARNING(logger_, "Failed write {} \n", std::string(strerror(errno)));
-                        else num_recv_bytes += static_cast<size_t>(write_bytes);
-
-                        if ((local_event_count > 0) && (local_event_count % 5000 == 0)) {
-                            SwitchWriteFile();
-                        }
-                        num_recv_mB_.store(num_recv_bytes / 1000000);
-                        num_event_chunk_words_.store(num_words / EVENTCHUNK);
-                        event_start = false; num_words = 0; event_words = 0; event_chunk = 0;
+                    event_start = true; event_start_count++;
+                    event_start_markers_++;
+                    event_begin = num_words;
+                }
+                else if (isEventEnd(word) && event_start) {
+                    // Check the FEM headers of the words between the start and end markers
+                    fem_validator_.CheckEvent(event_buffer_ptr + event_begin + 1, num_words - event_begin - 1);
+                    event_end_count++; event_start = false;
+                    event_end_markers_++;
+                    observe_event();
+                    dma_sizers_[0].AddEvent((num_words - event_begin + 1) * sizeof(uint32_t));
+                    if (event_builder_.IsEnabled()) {
+                        // The builder takes the sub-events, the record itself is not kept
+                        event_builder_.AddRecord(event_buffer_ptr + event_begin + 1, num_words - event_begin - 1,
+                                                 PipelineTimers::NowNs());
+                        num_words = event_begin;
+                        place_built_events(false);
+                    } else {
+                        finish_event();
                     }
-                } // word loop
+                    continue;
+                }
+                event_buffer_ptr[num_words] = word;
+                num_words++;
+            } // word loop
+            stage_timers_.Record(Stage::kEventScan, PipelineTimers::NowNs() - scan_start - write_ns);
+        };
+
+        // With the fibers read separately each has its own record in the making, complete records
+        // go straight to the event builder which puts the events back together by event number
+        struct FiberRecord {
+            std::vector<uint32_t> words;
+            bool is_open = false;
+        };
+        std::array<FiberRecord, kNumFibers> fiber_records;
+        auto process_fiber_buffer = [&]() {
+            const uint64_t scan_start = PipelineTimers::NowNs();
+            write_ns = 0;
+            const size_t fiber = word_arr.fiber % kNumFibers;
+            FiberRecord &record = fiber_records[fiber];
+            for (size_t i = 0; i < word_arr.num_words; i++) {
+                word = word_arr.words[i];
+                if (isEventStart(word)) {
+                    if (record.is_open) {
+                        // Previous record didn't finish, drop it
+                        observe_record(record.words.data(), 0, record.words.size());
+                        loss_ledger_.Record(LossReason::kTruncatedEvent);
+                    }
+                    record.words.clear();
+                    record.is_open = true;
+                    event_start_count++;
+                    event_start_markers_++;
+                } else if (isEventEnd(word) && record.is_open) {
+                    fem_validator_.CheckEvent(record.words.data(), record.words.size());
+                    event_end_count++;
+                    event_end_markers_++;
+                    observe_record(record.words.data(), 0, record.words.size());
+                    dma_sizers_[fiber].AddEvent((record.words.size() + 2) * sizeof(uint32_t));
+                    event_builder_.AddRecord(record.words.data(), record.words.size(), PipelineTimers::NowNs());
+                    record.words.clear();
+                    record.is_open = false;
+                    place_built_events(false);
+                } else if (record.is_open) {
+                    if (record.words.size() >= event_buffer_size) {
+                        LOG_WARNING(logger_, "Unexpectedly large record on fiber {}, dropping it! \n", fiber + 1);
+                        observe_record(record.words.data(), 0, record.words.size());
+                        loss_ledger_.Record(LossReason::kOversizeEvent);
+                        record.words.clear();
+                        record.is_open = false;
+                        continue;
+                    }
+                    record.words.push_back(word);
+                }
+            } // word loop
+            stage_timers_.Record(Stage::kEventScan, PipelineTimers::NowNs() - scan_start - write_ns);
+        };
+
+        while (!stop_write_.load()) {
+            while (data_queue_.read(word_arr)) {
+                if (per_fiber_dma_) process_fiber_buffer();
+                else process_buffer();
             } // read buffer loop
+            // Release the built events which have timed out while no data came in
+            if (event_builder_.IsEnabled() && !event_start) place_built_events(false);
         } // run loop
 
+        // The read thread can queue its last buffers just before setting the stop flag so
+        // drain the queue before closing the file.
+        while (data_queue_.read(word_arr)) {
+            if (per_fiber_dma_) process_fiber_buffer();
+            else process_buffer();
+        }
+        if (event_start) loss_ledger_.Record(LossReason::kRunStop);
+        for (const auto &record : fiber_records) {
+            if (record.is_open) loss_ledger_.Record(LossReason::kRunStop);
+        }
+        if (event_builder_.IsEnabled()) {
+            num_words = event_words; // drop a partial record
+            place_built_events(true);
+        }
+
         // Write any remaining full events in the buffer to file before closing
-        const int write_bytes = write(fd_, event_buffer_ptr, event_words*sizeof(uint32_t));
-        if (write_bytes == -1) LOG_WARNING(logger_, "Failed write {} \n", std::string(strerror(errno)));
-        else num_recv_bytes += static_cast<size_t>(write_bytes);
+        if (event_chunk > 0) write_chunk(event_words);
+        // Summaries of the events dropped since the last chunk
+        write_downlink();
+        while (write_compressed(true)) {}
+        compression_pool_.Stop();
+        // Publish what was accumulated since the last snapshot
+        pedestal_monitor_.Update(true);
+        occupancy_monitor_.Update(true);
 
         LOG_INFO(logger_, "Ended data write and closing file..\n");
-        // Make sure all data is flushed to file before closing
-        if(fsync(fd_) == -1) {
-            LOG_ERROR(logger_, "Failed to sync data file with error: {} \n", std::string(strerror(errno)));
+        if (striped_writer_.IsRunning()) {
+            // Waits for each directory to write out its queue, the last file is synced
+            striped_writer_.CloseFile(true);
+            striped_writer_.Stop();
+            if (striped_writer_.NumErrors() > 0) {
+                LOG_ERROR(logger_, "[{}] errors writing the striped data files \n", striped_writer_.NumErrors());
+            }
+        } else {
+            const int fd = data_file_.Finish();
+            // Make sure all data is flushed to file before closing
+            if(fsync(fd) == -1) {
+                LOG_ERROR(logger_, "Failed to sync data file with error: {} \n", std::string(strerror(errno)));
+            }
+            if(close(fd) == -1) {
+                LOG_ERROR(logger_, "Failed to close data file with error: {} \n", std::string(strerror(errno)));
+            }
         }
-        if(close(fd_) == -1) {
-            LOG_ERROR(logger_, "Failed to close data file with error: {} \n", std::string(strerror(errno)));
+
+        // The primary is closed first, then wait for the mirror to catch up
+        if (mirror_writer_.IsRunning()) {
+            mirror_writer_.Close(true);
+            mirror_writer_.Stop();
+            if (mirror_writer_.NumDropped() > 0) {
+                LOG_WARNING(logger_, "Mirror copy in {} is missing [{}] blocks \n", mirror_dir_, mirror_writer_.NumDropped());
+            }
+        }
+        if (downlink_writer_.IsRunning()) {
+            downlink_writer_.Close(true);
+            downlink_writer_.Stop();
+            if (downlink_writer_.NumDropped() > 0) {
+                LOG_WARNING(logger_, "Downlink stream is missing [{}] blocks ({} events) \n", downlink_writer_.NumDropped(),
+                            loss_ledger_.Count(LossReason::kDownlinkFull));
+            }
+        }
+        if (primitive_finder_.IsRunning()) {
+            primitive_finder_.CloseFile(true);
+            primitive_finder_.Stop();
+            if (primitive_finder_.NumErrors() > 0) {
+                LOG_ERROR(logger_, "[{}] errors writing the trigger primitive files \n", primitive_finder_.NumErrors());
+            }
+        }
+        if (stream_splitter_.IsRunning()) {
+            stream_splitter_.CloseFile(true);
+            stream_splitter_.Stop();
+            if (stream_splitter_.NumErrors() > 0) {
+                LOG_ERROR(logger_, "[{}] errors writing the light data files \n", stream_splitter_.NumErrors());
+            }
         }
 
+        file_flusher_.Stop();
+        WriteLossSummary();
+
         LOG_INFO(logger_, "Closed file after writing {}B to file {} \n", num_recv_bytes, write_file_name_);
         LOG_INFO(logger_, "Wrote {} events to {} files \n", event_count_.load(), file_count_.load());
         LOG_INFO(logger_, "Counted [{}] start events & [{}] end events \n", event_start_count, event_end_count);
@@ -356,20 +1088,34 @@ namespace data_handler {
 
         bool idebug = false;
         bool is_first_event = true;
-        static uint32_t iv, r_cs_reg;
-        static uint32_t num_dma_byte = DMABUFFSIZE;
-        static uint32_t is;
+        // Per fiber read state, whether its last transfer timed out and how many reads in a row sent nothing
+        std::array<bool, kNumFibers> fiber_timed_out{};
+        std::array<size_t, kNumFibers> fiber_empty_reads{};
+        // Nothing here is static since each card pair runs this in its own thread
+        uint32_t iv, r_cs_reg;
+        uint32_t num_dma_byte = DMABUFFSIZE;
+        uint32_t is;
 
         uint32_t data;
-        static unsigned long long u64Data;
-        static uint32_t *buffp_rec32;
-        static std::array<uint32_t, DATABUFFSIZE> word_arr{};
+        unsigned long long u64Data;
+        uint32_t *buffp_rec32;
+        auto read_block = std::make_unique<DmaBlock>();
+        DmaBlock &word_arr = *read_block;
 
         pcie_int::DMABufferHandle  pbuf_rec1;
         pcie_int::DMABufferHandle pbuf_rec2;
 
         // Init the metric counters
         dma_loop_count_.store(0);
+        backpressure_.Reset();
+        const size_t max_transfer_bytes = per_fiber_dma_ ? std::min(DMABUFFSIZE, kMaxFiberTransferBytes) : DMABUFFSIZE;
+        for (auto &dma_sizer : dma_sizers_) dma_sizer.Reset(max_transfer_bytes);
+        for (size_t fiber = 0; fiber < kNumFibers; fiber++) {
+            fiber_dma_timeouts_[fiber].store(0);
+            fiber_recv_bytes_[fiber].store(0);
+        }
+        using Stage = PipelineTimers::Stage;
+        uint64_t stage_start;
 
          /*TPC DMA*/
         LOG_INFO(logger_, "Buffer 1 & 2 allocation size: {} \n", DMABUFFSIZE);
@@ -390,21 +1136,53 @@ namespace data_handler {
         usleep(500000);
 
         std::thread trigger_thread;
-        if (software_trig_ == 1) {
+        if (software_trig_ == 1 && IsTriggerOwner()) {
             LOG_INFO(logger_, "Starting software trigger thread...\n");
             trigger_thread = std::thread(&trig_ctrl::TriggerControl::SendSoftwareTrigger, &trigger_,
                                             pcie_interface, software_trigger_rate_, trigger_module_);
         }
 
         while(is_running_.load() && event_count_.load() < num_events_) {
+            // Don't arm the next DMA while the triggers are throttled, any data already triggered
+            // stays buffered in the hardware until the write thread has drained the queue.
+            if (backpressure_.IsThrottled() && !WaitForQueueDrain()) break;
+            // Another card pair has paused the triggers, don't arm (and restart them) until it has drained
+            if (IsTriggerOwner() && !WaitForTriggerResume()) break;
             if (dma_loop_count_.load() % 500 == 0) LOG_INFO(logger_, "=======> DMA Loop [{}] \n", dma_loop_count_.load());
+            if (per_fiber_dma_) {
+                // Fiber 1 into buffer 1 then fiber 2 into buffer 2. A slow fiber times out and hands
+                // over to the other one, a stalled one is skipped most of the time.
+                bool trigger_sent = false;
+                for (size_t fiber = 0; fiber < kNumFibers; fiber++) {
+                    const bool is_idle = fiber_empty_reads[fiber] >= kIdleFiberReads;
+                    if (is_idle && (dma_loop_count_.load() % kIdleFiberProbeLoops) != 0) continue;
+                    const auto *buffp = static_cast<const uint32_t *>(fiber == 0 ? pbuf_rec1 : pbuf_rec2);
+                    const uint64_t timeout_ms = fiber_timed_out[fiber] ? kFiberProbeMs : fiber_timeout_ms_;
+                    size_t num_read = 0;
+                    const bool dma_done = ReadFiber(pcie_interface, fiber, buffp, word_arr, is_first_event,
+                                                    IsTriggerOwner() && (!trigger_sent || software_trig_),
+                                                    timeout_ms * 1000000, num_read);
+                    trigger_sent = true;
+                    fiber_timed_out[fiber] = !dma_done;
+                    fiber_empty_reads[fiber] = num_read > 0 ? 0 : fiber_empty_reads[fiber] + 1;
+                    ApplyBackpressure();
+                }
+                is_first_event = false;
+                dma_loop_count_++;
+                continue;
+            }
+            word_arr.fiber = 0;
             for (iv = 0; iv < 2; iv++) { // note: ndma_loop=1
-                static uint32_t dma_num = (iv % 2) == 0 ? 1 : 2;
+                const uint32_t dma_num = 1; // was a static set once on the first pass, always buffer 1
                 buffp_rec32 = dma_num == 1 ? static_cast<uint32_t *>(pbuf_rec1) : static_cast<uint32_t *>(pbuf_rec2);
                 // sync CPU cache
+                stage_start = PipelineTimers::NowNs();
                 pcie_interface->DmaSyncCpu(dma_num);
+                stage_start = stage_timers_.RecordSince(Stage::kCpuSync, stage_start);
 
-                if (idebug) LOG_DEBUG(logger_, "DMA loop {} with DMA length {}B \n", iv, DMABUFFSIZE);
+                // The receivers and the DMA are armed with the same byte count
+                num_dma_byte = dma_sizers_[0].TransferBytes();
+                if (idebug) LOG_DEBUG(logger_, "DMA loop {} with DMA length {}B \n", iv, num_dma_byte);
 
                 /** initialize and start the receivers ***/
                 for (size_t rcvr = 1; rcvr < 3; rcvr++) {
@@ -432,29 +1210,35 @@ namespace data_handler {
                 data = is == 0 ? hw_consts::dma_tr12 + hw_consts::dma_3dw_rec : hw_consts::dma_tr12 + hw_consts::dma_4dw_rec;
 
                 pcie_interface->WriteReg32(kDev2, hw_consts::cs_bar, hw_consts::cs_dma_cntrl, data);
-                if (idebug) LOG_DEBUG(logger_, "DMA set up done, byte count = {} \n", DMABUFFSIZE);
+                stage_timers_.RecordSince(Stage::kDmaArm, stage_start);
+                if (idebug) LOG_DEBUG(logger_, "DMA set up done, byte count = {} \n", num_dma_byte);
 
-                // send trigger
-                if (iv == 0) {
-                    trig_ctrl::TriggerControl::SendStartTrigger(pcie_interface, software_trig_, ext_trig_, trigger_module_);
-                } else if (software_trig_) {
+                // send trigger, only from the card pair which owns it
+                if (IsTriggerOwner() && (iv == 0 || software_trig_)) {
                     trig_ctrl::TriggerControl::SendStartTrigger(pcie_interface, software_trig_, ext_trig_, trigger_module_);
                 }
 
-                if (!WaitForDma(pcie_interface, &data, kDev2)) {
+                stage_start = PipelineTimers::NowNs();
+                const bool dma_done = WaitForDma(pcie_interface, &data, kDev2);
+                stage_start = stage_timers_.RecordSince(Stage::kDmaWait, stage_start);
+                if (!dma_done) {
                     LOG_WARNING(logger_, " loop [{}] DMA is not finished, aborting...  \n", iv);
                     pcie_interface->ReadReg64(kDev2,  hw_consts::cs_bar, hw_consts::cs_dma_by_cnt, &u64Data);
                     pcie_interface->DmaSyncIo(dma_num);
-                    static size_t num_read = (num_dma_byte - (u64Data & 0xffff));
+                    const size_t num_read = std::min(static_cast<size_t>(num_dma_byte - (u64Data & 0xffff)),
+                                                     static_cast<size_t>(num_dma_byte));
 
                     LOG_INFO(logger_, "Received {} bytes, writing to file.. \n", num_read);
 
-                    std::memcpy(word_arr.data(), buffp_rec32, num_read);
-                    data_queue_.write(word_arr);
-                    if (data_queue_.isFull()) {
+                    // Only what was received is passed on so stale data from the previous DMA isn't written again
+                    std::memcpy(word_arr.words.data(), buffp_rec32, num_read);
+                    word_arr.num_words = num_read / sizeof(uint32_t);
+                    loss_ledger_.Record(LossReason::kDmaAbort);
+                    if (!data_queue_.write(word_arr)) {
+                        loss_ledger_.Record(LossReason::kQueueFull);
                         read_write_buff_overflow_.store(true);
                         num_rw_buffer_overflow_++;
-                        LOG_ERROR(logger_, "Data read/write queue is full! This is unexpected! \n");
+                        LOG_ERROR(logger_, "Data read/write queue is full, dropped DMA buffer! \n");
                     }
                     ClearDmaOnAbort(pcie_interface, &u64Data, kDev2);
                     // If DMA did not finish, abort loop!
@@ -462,6 +1246,7 @@ namespace data_handler {
                 }
                 // sync DMA I/O cache
                 pcie_interface->DmaSyncIo(dma_num);
+                stage_start = stage_timers_.RecordSince(Stage::kCpuSync, stage_start);
 
                 if (idebug) {
                     u64Data = 0;
@@ -472,29 +1257,50 @@ namespace data_handler {
                     pcie_interface->ReadReg64(kDev2, hw_consts::cs_bar, hw_consts::t2_cs_reg, &u64Data);
                     LOG_DEBUG(logger_, " Status word for channel 1 after read = 0x{:X}, 0x{:X}", (u64Data >> 32), (u64Data & 0xffff));
                 }
-                std::memcpy(word_arr.data(), buffp_rec32, DMABUFFSIZE);
-                data_queue_.write(word_arr);
-                if (data_queue_.isFull()) {
+                stage_start = PipelineTimers::NowNs();
+                std::memcpy(word_arr.words.data(), buffp_rec32, num_dma_byte);
+                word_arr.num_words = num_dma_byte / sizeof(uint32_t);
+                stage_start = stage_timers_.RecordSince(Stage::kMemcpy, stage_start);
+                const bool queued = data_queue_.write(word_arr);
+                stage_timers_.RecordSince(Stage::kEnqueueWait, stage_start);
+                if (!queued) {
+                    loss_ledger_.Record(LossReason::kQueueFull);
                     read_write_buff_overflow_.store(true);
                     num_rw_buffer_overflow_++;
-                    LOG_ERROR(logger_, "Data read/write queue is full! This is unexpected! \n");
+                    LOG_ERROR(logger_, "Data read/write queue is full, dropped DMA buffer! \n");
                 }
+                ApplyBackpressure();
             } // end dma loop
             dma_loop_count_++;
         } // end loop over events
 
         LOG_DEBUG(logger_, "Stopping triggers..\n");
-        if (software_trig_) {
-            trigger_.StopTrigger(true);
-            if (trigger_thread.joinable()) trigger_thread.join();
+        if (IsTriggerOwner()) {
+            // The triggers are stopped below, the other pairs can't pause or resume them any more
+            std::lock_guard<std::mutex> lock(trigger_pause_mutex_);
+            trigger_interface_.store(nullptr);
+        }
+        // A pair which stops while throttled mustn't leave the triggers of the others paused
+        if (backpressure_.IsThrottled()) SetTriggerPause(false);
+        backpressure_.Finish();
+        if (IsTriggerOwner()) {
+            trigger_.PauseTrigger(false);
+            if (software_trig_) {
+                trigger_.StopTrigger(true);
+                if (trigger_thread.joinable()) trigger_thread.join();
+            }
+            trig_ctrl::TriggerControl::SendStopTrigger(pcie_interface, software_trig_, ext_trig_, trigger_module_);
         }
-        trig_ctrl::TriggerControl::SendStopTrigger(pcie_interface, software_trig_, ext_trig_, trigger_module_);
 
         // If event count triggered the end of run, set stop write flag so write thread completes
         LOG_DEBUG(logger_, "Stopping run and freeing pointer \n");
         stop_write_.store(true);
 
         if (num_rw_buffer_overflow_.load() > 0) LOG_WARNING(logger_, "Buffer full: [{}]\n", num_rw_buffer_overflow_.load());
+        if (backpressure_.NumThrottles() > 0) {
+            LOG_WARNING(logger_, "Triggers throttled [{}] times, dead time [{}]ms live time [{}]ms \n",
+                        backpressure_.NumThrottles(), backpressure_.DeadTimeMs(), backpressure_.LiveTimeMs());
+        }
 
         // Since the two PCIe buffer handles are scoped to this function, free the buffer before
         // they go out of scope
@@ -508,7 +1314,7 @@ namespace data_handler {
 
     void DataHandler::ReadoutViaController(pcie_int::PCIeInterface *pcie_interface, pcie_int::PcieBuffers *buffers) {
 
-        std::array<uint32_t, DATABUFFSIZE> word_arr{};
+        DmaBlock word_arr{};
         buffers->psend = buffers->buf_send.data();
 
         size_t num_controller_triggers = 1;
@@ -585,7 +1391,8 @@ namespace data_handler {
                 }
 
                 // Save header words
-                std::memcpy(word_arr.data(), pcie_int::PcieBuffers::read_array.data(), 6*sizeof(pcie_int::PcieBuffers::read_array[0]));
+                std::memcpy(word_arr.words.data(), pcie_int::PcieBuffers::read_array.data(), 6*sizeof(pcie_int::PcieBuffers::read_array[0]));
+                word_arr.num_words = 6;
                 data_queue_.write(word_arr);
                 if (data_queue_.isFull()) {
                     LOG_ERROR(logger_, "Data read/write queue is full! This is unexpected! \n");
@@ -607,7 +1414,8 @@ namespace data_handler {
                 pcie_interface->PCIeRecvBuffer(kDev1, 0, 2, nword, 1, buffers->precv);
 
                 // Save the rest of the event words
-                std::memcpy(word_arr.data(), pcie_int::PcieBuffers::read_array.data(), nword*sizeof(pcie_int::PcieBuffers::read_array[0]));
+                std::memcpy(word_arr.words.data(), pcie_int::PcieBuffers::read_array.data(), nword*sizeof(pcie_int::PcieBuffers::read_array[0]));
+                word_arr.num_words = nword;
                 data_queue_.write(word_arr);
                 if (data_queue_.isFull()) {
                     LOG_ERROR(logger_, "Data read/write queue is full! This is unexpected! \n");
@@ -753,20 +1561,162 @@ namespace data_handler {
         pcie_interface->WriteReg32(dev_num, hw_consts::cs_bar, hw_consts::cs_dma_msi_abort, 0);
     }
 
-    bool DataHandler::WaitForDma(pcie_int::PCIeInterface *pcie_interface, uint32_t *data, uint32_t dev_num) {
-        // Poll DMA until finished
-        // Can get stuck waiting for the DMA to finish, use is_running flag check to break from it
-        for (size_t is = 0; is < 6000000000; is++) {
+    bool DataHandler::WaitForDma(pcie_int::PCIeInterface *pcie_interface, uint32_t *data, uint32_t dev_num,
+                                 const uint64_t timeout_ns) {
+        // Poll DMA until finished. While running we wait as long as it takes since at low trigger
+        // rates the DMA can legitimately take a while. Once a stop is requested the transfer in
+        // flight gets until the stop deadline to finish before we return and it gets aborted.
+        const uint64_t wait_start = timeout_ns > 0 ? SteadyNowNs() : 0;
+        for (size_t is = 0; ; is++) {
             pcie_interface->ReadReg32(dev_num, hw_consts::cs_bar, hw_consts::cs_dma_cntrl, data);
             if ((*data & hw_consts::dma_in_progress) == 0) {
                 return true;
             }
             if ((is > 0) && ((is % 10000000) == 0)) std::cout << "Wait iter: " << is << "\n";
-            if (!is_running_.load()) break;
+            if (!is_running_.load() && StopDeadlinePassed()) break;
+            // Don't read the clock on every poll
+            if (timeout_ns > 0 && (is % 1024) == 0 && (SteadyNowNs() - wait_start) >= timeout_ns) break;
+        }
+        return false;
+    }
+
+    bool DataHandler::ReadFiber(pcie_int::PCIeInterface *pcie_interface, const size_t fiber,
+                                const uint32_t *buffp_rec32, DmaBlock &word_arr, const bool init_receiver,
+                                const bool send_trigger, const uint64_t timeout_ns, size_t &num_read) {
+        using Stage = PipelineTimers::Stage;
+        // Each fiber has its own receiver, DMA buffer and transfer size
+        const uint32_t dma_num = fiber + 1;
+        const uint32_t r_cs_reg = fiber == 0 ? hw_consts::r1_cs_reg : hw_consts::r2_cs_reg;
+        const uint32_t dma_tr = fiber == 0 ? hw_consts::dma_tr1 : hw_consts::dma_tr2;
+        const uint32_t num_dma_byte = dma_sizers_[fiber].TransferBytes();
+        uint32_t data;
+        unsigned long long u64Data = 0;
+
+        uint64_t stage_start = PipelineTimers::NowNs();
+        pcie_interface->DmaSyncCpu(dma_num);
+        stage_start = stage_timers_.RecordSince(Stage::kCpuSync, stage_start);
+
+        if (init_receiver) pcie_interface->WriteReg32(kDev2, hw_consts::cs_bar, r_cs_reg, hw_consts::cs_init);
+        pcie_interface->WriteReg32(kDev2, hw_consts::cs_bar, r_cs_reg, hw_consts::cs_start + num_dma_byte);
+
+        data = pcie_interface->GetBufferPageAddrLower(dma_num);
+        pcie_interface->WriteReg32(kDev2, hw_consts::cs_bar, hw_consts::cs_dma_add_low_reg, data);
+        data = pcie_interface->GetBufferPageAddrUpper(dma_num);
+        pcie_interface->WriteReg32(kDev2, hw_consts::cs_bar, hw_consts::cs_dma_add_high_reg, data);
+        pcie_interface->WriteReg32(kDev2, hw_consts::cs_bar, hw_consts::cs_dma_by_cnt, num_dma_byte);
+
+        /* write this will start DMA of this fiber only */
+        data = pcie_interface->GetBufferPageAddrUpper(dma_num) == 0 ? dma_tr + hw_consts::dma_3dw_rec :
+                                                                      dma_tr + hw_consts::dma_4dw_rec;
+        pcie_interface->WriteReg32(kDev2, hw_consts::cs_bar, hw_consts::cs_dma_cntrl, data);
+        stage_timers_.RecordSince(Stage::kDmaArm, stage_start);
+
+        if (send_trigger) {
+            trig_ctrl::TriggerControl::SendStartTrigger(pcie_interface, software_trig_, ext_trig_, trigger_module_);
+        }
+
+        stage_start = PipelineTimers::NowNs();
+        const bool dma_done = WaitForDma(pcie_interface, &data, kDev2, timeout_ns);
+        stage_start = stage_timers_.RecordSince(Stage::kDmaWait, stage_start);
+        num_read = num_dma_byte;
+        if (!dma_done) {
+            // Not an error, the fiber had less data than the transfer size. What came is passed on.
+            fiber_dma_timeouts_[fiber]++;
+            pcie_interface->ReadReg64(kDev2, hw_consts::cs_bar, hw_consts::cs_dma_by_cnt, &u64Data);
+            const size_t remaining = u64Data & 0xffff;
+            if (remaining > num_dma_byte) {
+                // Can't tell what arrived, the partial buffer is dropped rather than passing on
+                // stale data from the previous transfer
+                LOG_WARNING(logger_, "Fiber {} DMA remaining count {}B above the transfer size {}B, dropping it \n",
+                            fiber + 1, remaining, num_dma_byte);
+                loss_ledger_.Record(LossReason::kDmaAbort);
+                num_read = 0;
+            } else {
+                num_read = num_dma_byte - remaining;
+            }
+        }
+        pcie_interface->DmaSyncIo(dma_num);
+        stage_start = stage_timers_.RecordSince(Stage::kCpuSync, stage_start);
+
+        std::memcpy(word_arr.words.data(), buffp_rec32, num_read);
+        word_arr.num_words = num_read / sizeof(uint32_t);
+        word_arr.fiber = fiber;
+        stage_start = stage_timers_.RecordSince(Stage::kMemcpy, stage_start);
+        if (!dma_done) ClearDmaOnAbort(pcie_interface, &u64Data, kDev2);
+        if (word_arr.num_words == 0) return dma_done;
+
+        const bool queued = data_queue_.write(word_arr);
+        stage_timers_.RecordSince(Stage::kEnqueueWait, stage_start);
+        if (!queued) {
+            loss_ledger_.Record(LossReason::kQueueFull);
+            read_write_buff_overflow_.store(true);
+            num_rw_buffer_overflow_++;
+            LOG_ERROR(logger_, "Data read/write queue is full, dropped fiber {} DMA buffer! \n", fiber + 1);
+        }
+        fiber_recv_bytes_[fiber] += num_read;
+        return dma_done;
+    }
+
+    void DataHandler::SetTriggerPause(const bool pause) {
+        // The triggers belong to the owner, the other card pairs ask it so their data doesn't pile
+        // up in their hardware while they hold back their DMA
+        DataHandler *owner = IsTriggerOwner() ? this : trigger_owner_;
+        if (owner == nullptr) {
+            LOG_WARNING(logger_, "Card pair {} has no trigger owner to pause the triggers \n", card_index_);
+            return;
+        }
+        owner->RequestTriggerPause(pause);
+    }
+
+    void DataHandler::RequestTriggerPause(const bool pause) {
+        std::lock_guard<std::mutex> lock(trigger_pause_mutex_);
+        const size_t num_requests = num_pause_requests_.load();
+        if (!pause && num_requests == 0) return;
+        num_pause_requests_.store(pause ? num_requests + 1 : num_requests - 1);
+        // Only the first pause and the last resume go to the trigger module
+        if (pause ? num_requests > 0 : num_requests > 1) return;
+        pcie_int::PCIeInterface *pcie_interface = trigger_interface_.load();
+        if (pcie_interface == nullptr) return;
+        // The software trigger thread keeps running but stops sending while paused
+        if (software_trig_) trigger_.PauseTrigger(pause);
+        // Toggle the trigger module run bit, this covers both the software and external triggers.
+        // Only do it for these sources since `SendStartTrigger` would otherwise send a trigger.
+        if (software_trig_ || ext_trig_) {
+            if (pause) trig_ctrl::TriggerControl::SendStopTrigger(pcie_interface, software_trig_, ext_trig_, trigger_module_);
+            else trig_ctrl::TriggerControl::SendStartTrigger(pcie_interface, software_trig_, ext_trig_, trigger_module_);
+        }
+    }
+
+    void DataHandler::ApplyBackpressure() {
+        const size_t occupancy = data_queue_.sizeGuess();
+        if (backpressure_.Update(occupancy, data_queue_.capacity()) == BackpressureControl::Action::kThrottle) {
+            SetTriggerPause(true);
+            LOG_WARNING(logger_, "Read/write queue at [{}/{}], throttling triggers \n", occupancy, data_queue_.capacity());
+        }
+    }
+
+    bool DataHandler::WaitForQueueDrain() {
+        while (is_running_.load()) {
+            const size_t occupancy = data_queue_.sizeGuess();
+            if (backpressure_.Update(occupancy, data_queue_.capacity()) == BackpressureControl::Action::kResume) {
+                SetTriggerPause(false);
+                LOG_INFO(logger_, "Read/write queue drained to [{}/{}], resuming triggers. Dead time [{}]ms \n",
+                         occupancy, data_queue_.capacity(), backpressure_.DeadTimeMs());
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
         return false;
     }
 
+    bool DataHandler::WaitForTriggerResume() {
+        while (num_pause_requests_.load() > 0) {
+            if (!is_running_.load()) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
     void DataHandler::PollTriggerPPS(pcie_int::PCIeInterface *pcie_interface) {
         constexpr size_t PPS_BUFFER_SIZE = 250;
         std::array<uint32_t, 2> send_array{};
@@ -787,7 +1737,7 @@ namespace data_handler {
 
         size_t read_counter = 0;
         while (is_running_.load()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(pps_sample_period_));
+            if (!SleepWhileRunning(std::chrono::milliseconds(pps_sample_period_))) break;
             // init the receiver
             pcie_interface->PCIeRecvBuffer(1, 0, 1, num_status_words, 0, precv);
             // read out status =32 or read PPS register =35
@@ -846,7 +1796,8 @@ namespace data_handler {
         while (!data_queue_.isEmpty()) data_queue_.popFront();
 
         run_number_ = run_number;
-        write_file_name_ = data_basedir_ + "/readout_data/pGRAMS_bin_" + std::to_string(run_number_) + "_";
+        file_prefix_ = "pGRAMS_bin_" + std::to_string(run_number_) + card_tag_ + "_";
+        write_file_name_ = data_basedir_ + "/readout_data/" + file_prefix_;
         LOG_INFO(logger_, "Reset data handler..");
 
         return true;
@@ -7,12 +7,33 @@
 
 #include "pcie_control.h"
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <map>
+#include <mutex>
 #include <trigger_control.h>
 
 #include "json.hpp"
 #include "../../lib/folly/ProducerConsumerQueue.h"
+#include "backpressure_control.h"
+#include "fem_data_validator.h"
+#include "event_tap.h"
+#include "stage_timer.h"
+#include "data_file.h"
+#include "compression.h"
+#include "sample_packing.h"
+#include "zero_suppression.h"
+#include "striped_writer.h"
+#include "storage_manager.h"
+#include "event_builder.h"
+#include "stream_splitter.h"
+#include "pedestal_monitor.h"
+#include "occupancy_monitor.h"
+#include "downlink_selector.h"
+#include "primitive_finder.h"
+#include "loss_ledger.h"
+#include "dma_sizer.h"
 
 
 namespace data_handler {
@@ -24,13 +45,29 @@ public:
     ~DataHandler();
 
     void PinThread(std::thread& t, size_t core_id);
+    // The index of the PCIe card pair this pipeline reads, set before `Configure()`. Pair 0 owns
+    // the trigger, the files of the others are tagged with their card number.
+    void SetCard(size_t card_index);
+    size_t GetCard() const { return card_index_; }
+    bool IsTriggerOwner() const { return card_index_ == 0; }
+    // The pair the other pairs ask to pause the triggers when they throttle, set before the run
+    void SetTriggerOwner(DataHandler *trigger_owner) { trigger_owner_ = trigger_owner; }
+    // On the trigger owner, from the read thread of any pair. The triggers stay paused while any
+    // pair asks for it.
+    void RequestTriggerPause(bool pause);
+    // Shared by the card pairs so the storage manager sees the write rate of all the pairs on a disk
+    void SetStorageShare(std::shared_ptr<StorageShare> share) { storage_manager_.SetShare(std::move(share)); }
     uint32_t Configure(json &config);
 
     void CollectData(pcie_int::PCIeInterface *pcie_interface);
     std::vector<uint32_t> GetStatus();
     bool Reset(size_t run_number);
-    void SetRun(bool set_running) { is_running_.store(set_running); }
+    void SetRun(bool set_running);
     std::map<std::string, size_t> GetMetrics();
+    // Latest online pedestal/RMS table, empty until the first snapshot of the run
+    PedestalMonitor::Snapshot GetPedestalSnapshot() const { return pedestal_monitor_.GetSnapshot(); }
+    // Per channel hit counts of the last occupancy period, see `OccupancyMonitor`
+    std::vector<uint32_t> GetOccupancyHistogram() const { return occupancy_monitor_.GetHistogram(); }
     uint32_t getRunErrorCode() { return run_error_bit_.load(); }
 
 private:
@@ -42,16 +79,30 @@ private:
     void ReadoutViaController(pcie_int::PCIeInterface *pcie_interface, pcie_int::PcieBuffers *buffers);
     void TestReadoutDMARead(pcie_int::PCIeInterface *pcie_interface);
     void TriggerDMARead(pcie_int::PCIeInterface *pcie_interface);
-    bool WaitForDma(pcie_int::PCIeInterface *pcie_interface, uint32_t *data, uint32_t dev_num);
+    // A `timeout_ns` of 0 waits until the transfer is done or the run stops
+    bool WaitForDma(pcie_int::PCIeInterface *pcie_interface, uint32_t *data, uint32_t dev_num, uint64_t timeout_ns = 0);
     void ClearDmaOnAbort(pcie_int::PCIeInterface *pcie_interface, unsigned long long *u64Data, uint32_t dev_num);
     uint32_t DmaLoop(pcie_int::PCIeInterface *pcie_interface, uint32_t dma_num, size_t loop, unsigned long long *u64Data, bool is_first_loop);
     bool SetRecvBuffer(pcie_int::PCIeInterface *pcie_interface,
         pcie_int::DMABufferHandle *pbuf_rec1, pcie_int::DMABufferHandle *pbuf_rec2, bool is_data);
     bool SwitchWriteFile();
     void PollTriggerPPS(pcie_int::PCIeInterface *pcie_interface);
+    void ApplyBackpressure();
+    bool WaitForQueueDrain();
+    void SetTriggerPause(bool pause);
+    bool WaitForTriggerResume();
+    void SendPulseTrain();
+    bool SleepWhileRunning(std::chrono::milliseconds duration);
+    bool StopDeadlinePassed() const;
+    static uint64_t SteadyNowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
 
     static bool isEventStart(const uint32_t word) { return (word & 0xFFFFFFFF) == 0xFFFFFFFF; }
     static bool isEventEnd(const uint32_t word) { return (word & 0xFFFFFFFF) == 0xE0000000; }
+    static constexpr uint32_t kEventStartWord = 0xFFFFFFFF;
+    static constexpr uint32_t kEventEndWord = 0xE0000000;
 
     /*
      * The number of events to collect before writing to disk. Since small writes are inefficient
@@ -60,6 +111,10 @@ private:
      */
     constexpr static size_t EVENTCHUNK = 10;
 
+    // The number of written events after which the data file is switched. Counted per file as
+    // events can be left out (prescales) and chunks written short.
+    constexpr static size_t EVENTSPERFILE = 5000;
+
     /*
     * This is not configurable since we are sizing std::arrays which have to be known at compile time.
     * Additionally, this should be known/tuned and then not touched during data collection.
@@ -70,6 +125,7 @@ private:
     *
     * DMABUFFSIZE: This sets the size of the 2 contiguous memory DMA buffers. It is the expected event
     * size plus 30% so we are overestimating a little for reading efficiency reasons.
+    * With `dma_adaptive_enable` it is the largest transfer, each DMA only uses what the events need.
     *
     * DATABUFFSIZE: This is the width of the buffer between the read and write threads. The DMA buffer
     * is memory copied into it so it *must* be at least the same size as the DMA buffer size, otherwise
@@ -91,7 +147,18 @@ private:
     static constexpr uint32_t kDev1 = pcie_int::PCIeInterface::kDev1;
     static constexpr uint32_t kDev2 = pcie_int::PCIeInterface::kDev2;
 
-    typedef folly::ProducerConsumerQueue<std::array<uint32_t, DATABUFFSIZE>> Queue;
+    // A DMA buffer passed from the read to the write thread, only the first `num_words` are data
+    // as the transfers can be shorter than the buffer. `fiber` is the link it came from when
+    // the fibers are read separately, 0 otherwise.
+    struct DmaBlock {
+        std::array<uint32_t, DATABUFFSIZE> words;
+        size_t num_words;
+        size_t fiber;
+    };
+    // One transfer of a fiber, true if it completed before `timeout_ns`, the bytes passed on in `num_read`
+    bool ReadFiber(pcie_int::PCIeInterface *pcie_interface, size_t fiber, const uint32_t *buffp_rec32,
+                   DmaBlock &word_arr, bool init_receiver, bool send_trigger, uint64_t timeout_ns, size_t &num_read);
+    typedef folly::ProducerConsumerQueue<DmaBlock> Queue;
     Queue data_queue_;
     typedef folly::ProducerConsumerQueue<std::array<uint32_t, 8>> TrigQueue;
     TrigQueue trigger_queue_;
@@ -110,6 +177,9 @@ private:
     // Thread pinning to core and scheduler priority
     size_t read_core_id_;
     size_t write_core_id_;
+    bool pin_threads_ = false;
+    size_t card_index_ = 0;
+    std::string card_tag_;
 
     // Metric counters
     std::atomic<size_t> event_count_ = 0;
@@ -124,6 +194,49 @@ private:
     std::atomic<size_t> event_end_markers_ = 0;
     std::atomic<uint32_t> run_error_bit_ = 0;
 
+    // Pauses the triggers when the read/write queue fills and keeps track of the dead time
+    BackpressureControl backpressure_{};
+    // The triggers are paused for all the card pairs through the owner, which counts the pairs
+    // asking for it and sends the commands through its own interface while running
+    DataHandler *trigger_owner_ = nullptr;
+    std::mutex trigger_pause_mutex_;
+    std::atomic<size_t> num_pause_requests_ = 0;
+    std::atomic<pcie_int::PCIeInterface *> trigger_interface_ = nullptr;
+    // Sizes each DMA transfer from the event sizes, within the DMA buffers. Only the first is used
+    // unless the fibers are read separately.
+    static constexpr size_t kNumFibers = 2;
+    std::array<DmaSizer, kNumFibers> dma_sizers_{};
+
+    // With `per_fiber_dma_` each fiber is DMA'd on its own into its own buffer, in turn, and its
+    // records are assembled separately, the event builder merges them by event number. A fiber
+    // gets `fiber_timeout_ms_` after a full transfer, after one which timed out it is only probed
+    // for kFiberProbeMs, and once it has sent nothing kIdleFiberReads times in a row only every
+    // kIdleFiberProbeLoops loops, its data waits in the receiver until then.
+    bool per_fiber_dma_ = false;
+    size_t fiber_timeout_ms_ = 100;
+    // A fiber transfer normally ends on the timeout and what arrived is taken from the remaining
+    // byte count, which the DMA only reports in 16b, so the fiber transfers are kept below that
+    static constexpr size_t kMaxFiberTransferBytes = 0xF000;
+    static constexpr uint64_t kFiberProbeMs = 1;
+    static constexpr size_t kIdleFiberReads = 3;
+    static constexpr size_t kIdleFiberProbeLoops = 8;
+    std::array<std::atomic<size_t>, kNumFibers> fiber_dma_timeouts_{};
+    std::array<std::atomic<size_t>, kNumFibers> fiber_recv_bytes_{};
+    // Decodes the FEM headers in the write path and counts data integrity errors
+    FemDataValidator fem_validator_{};
+
+    // Shared memory tap for the data monitor, every `event_tap_prescale_` event and/or one event
+    // every `event_tap_period_ms_` is copied into the ring. Lossy so it never blocks the writer.
+    EventTapWriter event_tap_{};
+    bool event_tap_enable_ = false;
+    std::string event_tap_name_ = kDefaultEventTapName;
+    size_t event_tap_slots_ = 16;
+    size_t event_tap_prescale_ = 100;
+    size_t event_tap_period_ms_ = 0;
+    std::atomic<size_t> num_tapped_events_ = 0;
+
+    // Latency histograms of each stage of the read and write threads, to find the bottleneck
+    PipelineTimers stage_timers_{};
 
     std::atomic_bool read_write_buff_overflow_;
 
@@ -132,11 +245,98 @@ private:
 
     std::string data_basedir_;
     std::string write_file_name_;
+    std::string file_prefix_;
     std::atomic<size_t> file_count_;
+    // Written to the current file, write thread only
+    size_t events_in_file_ = 0;
 
     std::atomic_bool is_running_;
     std::atomic_bool stop_write_;
 
+    // Run stop protocol. Once a stop is requested the DMA in flight has `stop_timeout_ms_` to
+    // finish before it is aborted, the threads are then drained and joined and the time taken
+    // is reported as `stop_latency_ms_`. The cv wakes up any thread sleeping on the run state.
+    std::mutex run_mutex_;
+    std::condition_variable run_cv_;
+    std::atomic<uint64_t> stop_request_ns_ = 0;
+    std::atomic<size_t> stop_latency_ms_ = 0;
+    size_t stop_timeout_ms_ = 500;
+    size_t pulse_train_delay_ms_ = 4000;
+
+    // Data file writer, the self-describing container unless `use_container_format` is false
+    DataFileWriter data_file_{};
+    uint64_t config_hash_ = 0;
+    // Makes the written data durable every `sync_interval_mb` in the background for all the writers
+    FileFlusher file_flusher_{};
+    // Map the output files and build the events in place, only for raw data to a single directory
+    bool mmap_writer_enable_ = false;
+    size_t mmap_file_mb_ = 4000;
+
+    // With `output_dirs` set the files are striped over those directories instead, each with
+    // its own writer thread
+    StripedWriter striped_writer_{};
+    bool OpenDataFile(std::string &name);
+    ssize_t WriteDataBlock(const uint32_t *words, size_t num_words, uint64_t first_event, uint64_t last_event);
+
+    // Optional second copy of the data files in `mirror_dir_`, written from the same chunks on
+    // its own thread. If it falls behind mirror blocks are dropped, the primary is never held up.
+    AsyncFileWriter mirror_writer_{};
+    std::string mirror_dir_;
+    size_t mirror_queue_blocks_ = 16;
+
+    // Optional zstd compression of the write chunks on a pool of worker threads, the
+    // charge FEM hardware Huffman encoding is not used
+    CompressionPool compression_pool_{};
+    bool compression_enable_ = false;
+    int compression_level_ = 1;
+    size_t compression_threads_ = 2;
+    size_t compression_max_in_flight_ = 4;
+
+    // Zero suppression of the charge channels, applied to each event once it has been validated
+    ZeroSuppressor zero_suppression_{};
+    uint32_t charge_first_module_ = 0;
+    uint32_t charge_last_module_ = 31;
+
+    // Predicts when the data volumes fill up and switches to a reduced data mode before they do
+    StorageManager storage_manager_{};
+
+    // Rebuilds the events from the FEM sub-events by event and frame number when enabled
+    EventBuilder event_builder_{};
+
+    // Optionally writes the light FEM data to its own files in `light_dir_`, next to the charge files
+    StreamSplitter stream_splitter_{};
+    std::string light_dir_;
+
+    // Running pedestal and RMS of the charge channels from a prescaled sample of the events
+    PedestalMonitor pedestal_monitor_{};
+    // Channel hit and over threshold counts of the charge and light FEMs from a prescaled sample
+    OccupancyMonitor occupancy_monitor_{};
+
+    // Small per file downlink stream of event summaries and sampled events, selected on the
+    // write thread before any reduction. It is dropped from if it falls behind.
+    AsyncFileWriter downlink_writer_{};
+    DownlinkSelector downlink_selector_{};
+    bool downlink_enable_ = false;
+    std::string downlink_dir_;
+    size_t downlink_queue_blocks_ = 8;
+
+    // Trigger primitives of the charge waveforms in their own stream in `tp_dir_`, optionally
+    // with the full waveforms kept for a prescaled subset of the events only
+    PrimitiveFinder primitive_finder_{};
+    std::string tp_dir_;
+
+    // Where the data goes missing, by reason, and the summary of each file written next to it
+    LossLedger loss_ledger_{};
+    std::string current_file_name_;
+    void WriteLossSummary();
+    // Log the striping directories which were left out since the last call
+    void ReportFailedDirectories();
+
+    // Lossless 12b packing of the sample words on the write thread, before any compression
+    bool bit_packing_enable_ = false;
+    std::atomic<size_t> num_packing_in_bytes_ = 0;
+    std::atomic<size_t> num_packing_out_bytes_ = 0;
+
     pcie_int::DMABufferHandle  pbuf_rec1_{};
     pcie_int::DMABufferHandle pbuf_rec2_{};
 
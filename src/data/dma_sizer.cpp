@@ -0,0 +1,72 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "dma_sizer.h"
+#include <algorithm>
+
+namespace data_handler {
+
+    void DmaSizer::Configure(const bool enable, const double events_per_transfer, const size_t min_transfer_bytes,
+                             const size_t shrink_hold) {
+        enable_ = enable;
+        events_per_transfer_ = std::max(events_per_transfer, 0.1);
+        min_transfer_bytes_ = std::max(min_transfer_bytes, kPageBytes);
+        shrink_hold_ = shrink_hold;
+    }
+
+    void DmaSizer::Reset(const size_t max_transfer_bytes) {
+        max_transfer_bytes_ = max_transfer_bytes;
+        num_below_ = 0;
+        mean_event_bytes_x16_.store(0);
+        num_events_.store(0);
+        // Start from the full buffer until the first events are seen
+        transfer_bytes_.store(static_cast<uint32_t>(max_transfer_bytes_));
+        num_grows_.store(0);
+        num_shrinks_.store(0);
+    }
+
+    void DmaSizer::AddEvent(const size_t event_bytes) {
+        const uint64_t sample = static_cast<uint64_t>(event_bytes) << kMeanShift;
+        const uint64_t mean = mean_event_bytes_x16_.load(std::memory_order_relaxed);
+        // The first event sets the mean, then an exponential moving average
+        const uint64_t new_mean = num_events_.load(std::memory_order_relaxed) == 0 ? sample :
+                                  mean + (static_cast<int64_t>(sample - mean) >> kMeanShift);
+        mean_event_bytes_x16_.store(new_mean, std::memory_order_relaxed);
+        num_events_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t DmaSizer::TransferBytes() {
+        const uint32_t current = transfer_bytes_.load(std::memory_order_relaxed);
+        if (!enable_ || num_events_.load(std::memory_order_relaxed) == 0) return current;
+
+        const double mean = static_cast<double>(mean_event_bytes_x16_.load(std::memory_order_relaxed) >> kMeanShift);
+        size_t target = static_cast<size_t>(mean * events_per_transfer_ * kMargin);
+        target = ((target + kPageBytes - 1) / kPageBytes) * kPageBytes;
+        target = std::clamp(target, std::min(min_transfer_bytes_, max_transfer_bytes_), max_transfer_bytes_);
+
+        if (target > current) {
+            num_below_ = 0;
+            num_grows_++;
+            transfer_bytes_.store(static_cast<uint32_t>(target), std::memory_order_relaxed);
+            return static_cast<uint32_t>(target);
+        }
+        if (target >= kShrinkFraction * current) {
+            num_below_ = 0;
+            return current;
+        }
+        if (++num_below_ < shrink_hold_) return current;
+        num_below_ = 0;
+        num_shrinks_++;
+        transfer_bytes_.store(static_cast<uint32_t>(target), std::memory_order_relaxed);
+        return static_cast<uint32_t>(target);
+    }
+
+    void DmaSizer::AddMetrics(std::map<std::string, size_t> &metrics, const std::string &prefix) const {
+        metrics[prefix + "transfer_bytes"] = transfer_bytes_.load();
+        metrics[prefix + "mean_event_bytes"] = mean_event_bytes_x16_.load() >> kMeanShift;
+        metrics[prefix + "transfer_grows"] = num_grows_.load();
+        metrics[prefix + "transfer_shrinks"] = num_shrinks_.load();
+    }
+
+} // data_handler
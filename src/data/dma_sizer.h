@@ -0,0 +1,75 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef DMA_SIZER_H
+#define DMA_SIZER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace data_handler {
+
+/*
+ * Chooses the byte count of each DMA transfer from the event sizes seen by the write thread,
+ * so the transfers fit the events of the running configuration without tuning
+ * `dma_buffer_size_kb` by hand. The locked DMA buffers stay at their configured size, which is
+ * the largest transfer allowed.
+ *
+ * The write thread feeds in the raw size of every event (start to end marker, before any
+ * reduction) and keeps a running mean. Before each DMA the read thread asks for the transfer
+ * size, `events_per_transfer` mean events plus 30% rounded up to 4kB, so an event is rarely
+ * split over two transfers. A transfer which is too small splits events so it grows at once,
+ * it only shrinks once the target has stayed at least a quarter below the current size for
+ * `shrink_hold` transfers, so it doesn't follow every fluctuation in the light activity.
+ *
+ * `AddEvent()` is only called from the write thread and `TransferBytes()` from the read
+ * thread, the metrics can be read from any thread.
+ */
+class DmaSizer {
+public:
+
+    DmaSizer() = default;
+    ~DmaSizer() = default;
+
+    void Configure(bool enable, double events_per_transfer, size_t min_transfer_bytes, size_t shrink_hold);
+    // Start of a run, transfers are never above `max_transfer_bytes`, the locked buffer size
+    void Reset(size_t max_transfer_bytes);
+    bool IsEnabled() const { return enable_; }
+
+    void AddEvent(size_t event_bytes);
+    // The byte count of the next transfer
+    uint32_t TransferBytes();
+
+    void AddMetrics(std::map<std::string, size_t> &metrics, const std::string &prefix = "dma_") const;
+
+private:
+
+    static constexpr size_t kPageBytes = 4096;
+    static constexpr double kMargin = 1.3;
+    static constexpr double kShrinkFraction = 0.75;
+    // The mean is kept in 1/16 byte steps and follows the last ~16 events
+    static constexpr uint64_t kMeanShift = 4;
+
+    bool enable_ = false;
+    double events_per_transfer_ = 1.;
+    size_t min_transfer_bytes_ = 64 * 1024;
+    size_t max_transfer_bytes_ = 0;
+    size_t shrink_hold_ = 50;
+
+    // Read thread only
+    size_t num_below_ = 0;
+
+    std::atomic<uint64_t> mean_event_bytes_x16_ = 0;
+    std::atomic<uint64_t> num_events_ = 0;
+    std::atomic<uint32_t> transfer_bytes_ = 0;
+    std::atomic<size_t> num_grows_ = 0;
+    std::atomic<size_t> num_shrinks_ = 0;
+};
+
+} // data_handler
+
+#endif //DMA_SIZER_H
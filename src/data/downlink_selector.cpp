@@ -0,0 +1,105 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "downlink_selector.h"
+#include "fem_data_validator.h"
+
+namespace data_handler {
+
+    namespace {
+        constexpr uint32_t kEventStartWord = 0xFFFFFFFF;
+        constexpr uint32_t kEventEndWord = 0xE0000000;
+    }
+
+    void DownlinkSelector::Configure(const size_t prescale, const double random_fraction, const uint64_t budget_bytes) {
+        prescale_ = prescale;
+        random_fraction_ = random_fraction;
+        budget_bytes_ = budget_bytes;
+    }
+
+    void DownlinkSelector::Reset() {
+        num_events_seen_ = 0;
+        file_sampled_bytes_ = 0;
+        summaries_.clear();
+        sampled_.clear();
+        num_block_events_ = 0;
+        num_summaries_.store(0);
+        num_sampled_.store(0);
+        num_over_budget_.store(0);
+    }
+
+    void DownlinkSelector::NewFile() {
+        file_sampled_bytes_ = 0;
+    }
+
+    bool DownlinkSelector::IsSampled(const size_t event_words) {
+        num_events_seen_++;
+        const bool is_selected = (prescale_ > 0 && (num_events_seen_ % prescale_) == 0) ||
+                                 (random_fraction_ > 0. && uniform_(rng_) < random_fraction_);
+        if (!is_selected) return false;
+        const uint64_t event_bytes = event_words * sizeof(uint32_t);
+        if (file_sampled_bytes_ + event_bytes > budget_bytes_) {
+            num_over_budget_++;
+            return false;
+        }
+        file_sampled_bytes_ += event_bytes;
+        return true;
+    }
+
+    void DownlinkSelector::AddEvent(const uint32_t *words, const size_t num_words, const uint64_t event_number) {
+        // The event is described by its first FEM and which modules it has
+        uint32_t flags = 0;
+        uint32_t num_fems = 0;
+        uint32_t module_mask = 0;
+        FemDataValidator::FemHeader first_header{};
+        size_t header_idx = FemDataValidator::FindNextHeader(words, 0, num_words);
+        if (header_idx + FemDataValidator::kHeaderWords > num_words) flags |= kFlagNoFemHeader;
+        while (header_idx + FemDataValidator::kHeaderWords <= num_words) {
+            const FemDataValidator::FemHeader header = FemDataValidator::DecodeHeader(words + header_idx);
+            if (num_fems == 0) first_header = header;
+            num_fems++;
+            module_mask |= 1u << header.module;
+            header_idx = FemDataValidator::FindNextHeader(words, header_idx + FemDataValidator::kHeaderWords, num_words);
+        }
+
+        const size_t event_words = num_words + 2;
+        if (IsSampled(event_words)) {
+            flags |= kFlagSampled;
+            sampled_.push_back(kEventStartWord);
+            sampled_.insert(sampled_.end(), words, words + num_words);
+            sampled_.push_back(kEventEndWord);
+            num_sampled_++;
+        }
+        summaries_.push_back(kSummaryMarker | (flags << 16) | (num_fems & 0xFFFF));
+        summaries_.push_back(module_mask);
+        summaries_.push_back(first_header.event_number);
+        summaries_.push_back(first_header.frame_number);
+        summaries_.push_back(static_cast<uint32_t>(event_words));
+        num_summaries_++;
+
+        if (num_block_events_ == 0) block_first_event_ = event_number;
+        block_last_event_ = event_number;
+        num_block_events_++;
+    }
+
+    size_t DownlinkSelector::TakeBlock(std::vector<uint32_t> &block, uint64_t &first_event, uint64_t &last_event) {
+        const size_t num_events = num_block_events_;
+        block.clear();
+        if (num_events == 0) return 0;
+        block.swap(summaries_);
+        block.insert(block.end(), sampled_.begin(), sampled_.end());
+        sampled_.clear();
+        first_event = block_first_event_;
+        last_event = block_last_event_;
+        num_block_events_ = 0;
+        return num_events;
+    }
+
+    void DownlinkSelector::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["downlink_summaries"] = num_summaries_.load();
+        metrics["downlink_sampled_events"] = num_sampled_.load();
+        metrics["downlink_over_budget"] = num_over_budget_.load();
+    }
+
+} // data_handler
@@ -0,0 +1,83 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef DOWNLINK_SELECTOR_H
+#define DOWNLINK_SELECTOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace data_handler {
+
+/*
+ * Picks what goes into the small per file "downlink" stream, which is all that fits through
+ * the balloon link. Fed by the write thread with every event as it was read out, before the
+ * prescales, zero suppression or light split, so the summaries cover the dropped events too
+ * and the sampled events are complete. Only the sampled events are copied.
+ *
+ * The events since the last `TakeBlock()` come out as one block of
+ *   [kSummaryWords summary for every event...] [sampled full events...]
+ * A full event is sampled every `prescale`th event and/or at random with probability
+ * `random_fraction`, as long as the sampled events of the current file stay within
+ * `budget_bytes`; the summaries are always written. A summary is
+ *   0xD5000000 | flags << 16 | number of FEMs,  module presence mask,
+ *   FEM event number,  FEM frame number,  event size in words (with the markers)
+ * taken from the first FEM header of the event, flag kFlagSampled if the full event follows.
+ *
+ * The counters can be read from any thread, the rest is for the write thread only.
+ */
+class DownlinkSelector {
+public:
+
+    static constexpr uint32_t kSummaryMarker = 0xD5000000;
+    static constexpr size_t kSummaryWords = 5;
+    static constexpr uint32_t kFlagSampled = 0x1;
+    static constexpr uint32_t kFlagNoFemHeader = 0x2;
+
+    DownlinkSelector() = default;
+    ~DownlinkSelector() = default;
+
+    // Only between runs, a prescale of 0 turns the prescaled sample off
+    void Configure(size_t prescale, double random_fraction, uint64_t budget_bytes);
+    void Reset();
+    void NewFile();
+
+    // The FEM words of an event, without its start and end markers
+    void AddEvent(const uint32_t *words, size_t num_words, uint64_t event_number);
+    // Hand over the block of the events added since the last call, returns the number of events
+    size_t TakeBlock(std::vector<uint32_t> &block, uint64_t &first_event, uint64_t &last_event);
+
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+private:
+
+    bool IsSampled(size_t event_words);
+
+    size_t prescale_ = 100;
+    double random_fraction_ = 0.;
+    uint64_t budget_bytes_ = 1000000;
+
+    std::mt19937_64 rng_{std::random_device{}()};
+    std::uniform_real_distribution<double> uniform_{0., 1.};
+    uint64_t num_events_seen_ = 0;
+    uint64_t file_sampled_bytes_ = 0;
+    std::vector<uint32_t> summaries_;
+    std::vector<uint32_t> sampled_;
+    size_t num_block_events_ = 0;
+    uint64_t block_first_event_ = 0;
+    uint64_t block_last_event_ = 0;
+
+    std::atomic<size_t> num_summaries_ = 0;
+    std::atomic<size_t> num_sampled_ = 0;
+    std::atomic<size_t> num_over_budget_ = 0;
+};
+
+} // data_handler
+
+#endif //DOWNLINK_SELECTOR_H
@@ -0,0 +1,195 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "event_builder.h"
+#include "fem_data_validator.h"
+#include <algorithm>
+
+namespace data_handler {
+
+    namespace {
+        constexpr uint64_t kEventNumberRange = 1ULL << 24;
+        // Start the unwrapped numbers one wrap up so an event just before the first one stays positive
+        constexpr uint64_t kEventNumberOffset = kEventNumberRange;
+
+        uint32_t HeaderWord(const uint32_t type, const uint32_t value) {
+            return EventBuilder::kHeaderMarker | (type << 16) | (value & 0xFFF);
+        }
+    }
+
+    void EventBuilder::Configure(const bool enable, const uint32_t expected_mask, const size_t window,
+                                 const size_t timeout_ms) {
+        enable_ = enable;
+        expected_mask_ = expected_mask;
+        window_ = std::max(window, size_t{1});
+        timeout_ns_ = timeout_ms * 1000000ULL;
+    }
+
+    void EventBuilder::Reset() {
+        for (auto &entry : pending_) free_pending_.push_back(std::move(entry.second));
+        pending_.clear();
+        has_event_number_ = false;
+        has_released_ = false;
+        num_built_.store(0);
+        num_complete_.store(0);
+        num_timeouts_.store(0);
+        num_evicted_.store(0);
+        num_duplicates_.store(0);
+        num_late_.store(0);
+        num_orphan_words_.store(0);
+        max_pending_.store(0);
+    }
+
+    uint64_t EventBuilder::Unwrap(const uint32_t event_number) {
+        if (!has_event_number_) {
+            has_event_number_ = true;
+            last_event_number_ = kEventNumberOffset + event_number;
+            return last_event_number_;
+        }
+        // Take the closest match to the latest event, either side of a wrap
+        int64_t diff = static_cast<int64_t>(event_number) - static_cast<int64_t>(last_event_number_ % kEventNumberRange);
+        if (diff > static_cast<int64_t>(kEventNumberRange / 2)) diff -= kEventNumberRange;
+        if (diff < -static_cast<int64_t>(kEventNumberRange / 2)) diff += kEventNumberRange;
+        const uint64_t unwrapped = last_event_number_ + diff;
+        last_event_number_ = std::max(last_event_number_, unwrapped);
+        return unwrapped;
+    }
+
+    EventBuilder::Pending &EventBuilder::GetPending(const Key &key, const uint32_t event_number,
+                                                    const uint32_t frame_number, const uint64_t now_ns) {
+        auto it = pending_.find(key);
+        if (it != pending_.end()) return *it->second;
+
+        std::unique_ptr<Pending> pending;
+        if (free_pending_.empty()) {
+            pending = std::make_unique<Pending>();
+        } else {
+            pending = std::move(free_pending_.back());
+            free_pending_.pop_back();
+        }
+        pending->event_number = event_number;
+        pending->frame_number = frame_number;
+        pending->presence_mask = 0;
+        pending->first_seen_ns = now_ns;
+        pending->words.clear();
+        pending->sub_events.clear();
+        // Its place in the output has already gone, it is sent out as soon as it is due
+        pending->status = (has_released_ && key <= last_released_) ? kStatusLate : 0;
+        if (pending->status & kStatusLate) num_late_++;
+        Pending &ref = *pending;
+        pending_.emplace(key, std::move(pending));
+        if (pending_.size() > max_pending_.load()) max_pending_.store(pending_.size());
+        return ref;
+    }
+
+    void EventBuilder::AddRecord(const uint32_t *words, const size_t num_words, const uint64_t now_ns) {
+        size_t header_idx = FemDataValidator::FindNextHeader(words, 0, num_words);
+        num_orphan_words_ += header_idx;
+        while (header_idx < num_words) {
+            const size_t payload_begin = std::min(header_idx + FemDataValidator::kHeaderWords, num_words);
+            const size_t next_header = FemDataValidator::FindNextHeader(words, payload_begin, num_words);
+            if (payload_begin - header_idx < FemDataValidator::kHeaderWords) {
+                num_orphan_words_ += next_header - header_idx; // truncated header
+                header_idx = next_header;
+                continue;
+            }
+            const FemDataValidator::FemHeader header = FemDataValidator::DecodeHeader(words + header_idx);
+            const Key key{Unwrap(header.event_number), header.frame_number};
+            Pending &pending = GetPending(key, header.event_number, header.frame_number, now_ns);
+
+            const uint32_t module_bit = 1u << header.module;
+            if (pending.presence_mask & module_bit) {
+                pending.status |= kStatusDuplicate;
+                num_duplicates_++;
+            }
+            pending.presence_mask |= module_bit;
+            pending.sub_events.push_back({header.module, pending.words.size(), next_header - header_idx});
+            pending.words.insert(pending.words.end(), words + header_idx, words + next_header);
+            header_idx = next_header;
+        }
+    }
+
+    bool EventBuilder::NextEvent(BuiltEvent &event, const uint64_t now_ns, const bool flush) {
+        if (pending_.empty()) return false;
+        auto it = pending_.begin();
+        Pending &pending = *it->second;
+
+        const bool is_complete = (pending.presence_mask & expected_mask_) == expected_mask_;
+        const bool is_timeout = (now_ns - pending.first_seen_ns) >= timeout_ns_;
+        const bool is_evicted = pending_.size() > window_;
+        const bool is_late = (pending.status & kStatusLate) != 0;
+        if (!(is_complete || is_timeout || is_evicted || is_late || flush)) return false;
+
+        uint32_t status = pending.status;
+        if (is_complete) {
+            status |= kStatusComplete;
+            num_complete_++;
+        } else if (is_timeout) {
+            status |= kStatusTimeout;
+            num_timeouts_++;
+        } else if (is_evicted) {
+            status |= kStatusEvicted;
+            num_evicted_++;
+        } else if (flush) {
+            status |= kStatusFlushed;
+        }
+
+        event.event_number = pending.event_number;
+        event.frame_number = pending.frame_number;
+        event.presence_mask = pending.presence_mask;
+        event.status = status;
+        event.words.clear();
+        // Stable so duplicates keep their arrival order
+        std::stable_sort(pending.sub_events.begin(), pending.sub_events.end(),
+                         [](const SubEvent &a, const SubEvent &b) { return a.module < b.module; });
+        for (const auto &sub_event : pending.sub_events) {
+            event.words.insert(event.words.end(), pending.words.begin() + sub_event.begin,
+                               pending.words.begin() + sub_event.begin + sub_event.size);
+        }
+
+        if (!has_released_ || it->first > last_released_) last_released_ = it->first;
+        has_released_ = true;
+        free_pending_.push_back(std::move(it->second));
+        pending_.erase(it);
+        num_built_++;
+        return true;
+    }
+
+    void EventBuilder::EncodeHeader(const BuiltEvent &event, uint32_t *header) {
+        header[0] = HeaderWord(0, event.presence_mask);
+        header[1] = HeaderWord(1, event.presence_mask >> 12);
+        header[2] = HeaderWord(2, event.presence_mask >> 24);
+        header[3] = HeaderWord(3, event.event_number);
+        header[4] = HeaderWord(4, event.event_number >> 12);
+        header[5] = HeaderWord(5, event.frame_number);
+        header[6] = HeaderWord(6, event.frame_number >> 12);
+        header[7] = HeaderWord(7, event.status);
+    }
+
+    bool EventBuilder::DecodeHeader(const uint32_t *words, const size_t num_words, BuiltEvent &event) {
+        // Skip the start marker if it is there
+        if (num_words > 0 && words[0] == 0xFFFFFFFF) return DecodeHeader(words + 1, num_words - 1, event);
+        if (num_words < kHeaderWords) return false;
+        for (uint32_t i = 0; i < kHeaderWords; i++) {
+            if ((words[i] & 0xFFFFF000) != HeaderWord(i, 0)) return false;
+        }
+        event.presence_mask = (words[0] & 0xFFF) | ((words[1] & 0xFFF) << 12) | ((words[2] & 0xFF) << 24);
+        event.event_number = (words[3] & 0xFFF) | ((words[4] & 0xFFF) << 12);
+        event.frame_number = (words[5] & 0xFFF) | ((words[6] & 0xFFF) << 12);
+        event.status = words[7] & 0xFFF;
+        return true;
+    }
+
+    void EventBuilder::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["eb_built_events"] = num_built_.load();
+        metrics["eb_complete_events"] = num_complete_.load();
+        metrics["eb_timeouts"] = num_timeouts_.load();
+        metrics["eb_evicted"] = num_evicted_.load();
+        metrics["eb_duplicates"] = num_duplicates_.load();
+        metrics["eb_late_subevents"] = num_late_.load();
+        metrics["eb_orphan_words"] = num_orphan_words_.load();
+        metrics["eb_max_pending"] = max_pending_.load();
+    }
+
+} // data_handler
@@ -0,0 +1,130 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef EVENT_BUILDER_H
+#define EVENT_BUILDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace data_handler {
+
+/*
+ * Online event builder for the charge and light FEM sub-events.
+ *
+ * The XMIT stream is split on the event start/end markers but the FEM sub-events between a
+ * pair of markers don't have to belong to the same trigger. Each sub-event is keyed on its
+ * FEM event and frame number (the 24b event number is unwrapped) and collected until every
+ * expected module has been seen. Events go out in event number order: the oldest pending
+ * event is released once it is complete, once it is older than the timeout or when more than
+ * `window` events are pending, whichever comes first. The sub-events of a built event are
+ * in module order.
+ *
+ * A built event is written as
+ *   0xFFFFFFFF [kHeaderWords builder header] [FEM sub-events...] 0xE0000000
+ * where each header word is 0xEB000000 | (type << 16) | 12b value, so it can't be mistaken for
+ * a FEM header or an event marker:
+ *   type 0-2: presence mask of modules 0-11, 12-23, 24-31
+ *   type 3-4: event number low/high 12b
+ *   type 5-6: frame number low/high 12b
+ *   type 7:   status bits, see kStatus*
+ *
+ * Owned by the write thread, the counters can be read from any thread.
+ */
+class EventBuilder {
+public:
+
+    struct BuiltEvent {
+        uint32_t event_number = 0;
+        uint32_t frame_number = 0;
+        uint32_t presence_mask = 0;
+        uint32_t status = 0;
+        std::vector<uint32_t> words; // the FEM sub-events, headers included
+    };
+
+    static constexpr uint32_t kStatusComplete = 0x1;
+    static constexpr uint32_t kStatusTimeout = 0x2;   // released incomplete after the timeout
+    static constexpr uint32_t kStatusEvicted = 0x4;   // released incomplete as the window was full
+    static constexpr uint32_t kStatusDuplicate = 0x8; // a module sent more than one sub-event
+    static constexpr uint32_t kStatusLate = 0x10;     // arrived after later events had gone out
+    static constexpr uint32_t kStatusFlushed = 0x20;  // released at the end of the run
+
+    static constexpr uint32_t kHeaderMarker = 0xEB000000;
+    static constexpr size_t kHeaderWords = 8;
+
+    EventBuilder() = default;
+    ~EventBuilder() = default;
+
+    void Configure(bool enable, uint32_t expected_mask, size_t window, size_t timeout_ms);
+    bool IsEnabled() const { return enable_; }
+    void Reset();
+
+    // Take the FEM sub-events of the words between an event start and end marker (exclusive)
+    void AddRecord(const uint32_t *words, size_t num_words, uint64_t now_ns);
+    // The next event due to go out, false if there is none yet. With `flush` every pending
+    // event is due, for the end of the run.
+    bool NextEvent(BuiltEvent &event, uint64_t now_ns, bool flush);
+    size_t NumPending() const { return pending_.size(); }
+
+    static void EncodeHeader(const BuiltEvent &event, uint32_t *header);
+    // Read back the header behind the start marker, false if the words are not a built event
+    static bool DecodeHeader(const uint32_t *words, size_t num_words, BuiltEvent &event);
+
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+private:
+
+    struct SubEvent {
+        uint32_t module;
+        size_t begin;
+        size_t size;
+    };
+
+    struct Pending {
+        uint32_t event_number = 0;
+        uint32_t frame_number = 0;
+        uint32_t presence_mask = 0;
+        uint32_t status = 0;
+        uint64_t first_seen_ns = 0;
+        std::vector<uint32_t> words;
+        std::vector<SubEvent> sub_events;
+    };
+
+    // Unwrapped event number and the frame number
+    using Key = std::pair<uint64_t, uint32_t>;
+
+    uint64_t Unwrap(uint32_t event_number);
+    Pending &GetPending(const Key &key, uint32_t event_number, uint32_t frame_number, uint64_t now_ns);
+
+    bool enable_ = false;
+    uint32_t expected_mask_ = 0;
+    size_t window_ = 16;
+    uint64_t timeout_ns_ = 1000000000;
+
+    std::map<Key, std::unique_ptr<Pending>> pending_;
+    std::vector<std::unique_ptr<Pending>> free_pending_;
+    bool has_event_number_ = false;
+    uint64_t last_event_number_ = 0;
+    bool has_released_ = false;
+    Key last_released_{};
+
+    std::atomic<size_t> num_built_ = 0;
+    std::atomic<size_t> num_complete_ = 0;
+    std::atomic<size_t> num_timeouts_ = 0;
+    std::atomic<size_t> num_evicted_ = 0;
+    std::atomic<size_t> num_duplicates_ = 0;
+    std::atomic<size_t> num_late_ = 0;
+    std::atomic<size_t> num_orphan_words_ = 0;
+    std::atomic<size_t> max_pending_ = 0;
+};
+
+} // data_handler
+
+#endif //EVENT_BUILDER_H
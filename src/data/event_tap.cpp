@@ -0,0 +1,167 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "event_tap.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace data_handler {
+
+    namespace {
+        // Keep the slots on their own cache lines
+        size_t SlotStride(const size_t slot_words) {
+            const size_t bytes = sizeof(EventTapSlot) + slot_words * sizeof(uint32_t);
+            return (bytes + 63) & ~static_cast<size_t>(63);
+        }
+
+        size_t HeaderStride() {
+            return (sizeof(EventTapHeader) + 63) & ~static_cast<size_t>(63);
+        }
+    }
+
+    EventTapWriter::~EventTapWriter() {
+        Close();
+    }
+
+    bool EventTapWriter::Open(const std::string &name, const size_t num_slots, const size_t slot_words) {
+        Close();
+        if (num_slots == 0 || slot_words == 0) return false;
+
+        const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd == -1) return false;
+
+        slot_stride_ = SlotStride(slot_words);
+        map_size_ = HeaderStride() + num_slots * slot_stride_;
+        if (ftruncate(fd, static_cast<off_t>(map_size_)) == -1) {
+            close(fd);
+            return false;
+        }
+        void *addr = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd); // the mapping keeps the memory alive
+        if (addr == MAP_FAILED) return false;
+
+        // Invalidate the header while (re-)initializing so readers don't attach to a half made ring
+        std::memset(addr, 0, map_size_);
+        header_ = static_cast<EventTapHeader *>(addr);
+        header_->num_slots = static_cast<uint32_t>(num_slots);
+        header_->slot_words = static_cast<uint32_t>(slot_words);
+        header_->version = EventTapHeader::kVersion;
+        header_->write_seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = EventTapHeader::kMagic;
+        name_ = name;
+        return true;
+    }
+
+    void EventTapWriter::Close() {
+        if (header_ == nullptr) return;
+        munmap(header_, map_size_);
+        // Readers which are still attached keep their mapping, the name is freed for the next run
+        shm_unlink(name_.c_str());
+        header_ = nullptr;
+        map_size_ = 0;
+    }
+
+    bool EventTapWriter::Publish(const uint32_t *words, const size_t num_words, const uint64_t event_count) {
+        if (header_ == nullptr || num_words > header_->slot_words) return false;
+
+        const uint64_t seq = header_->write_seq.load(std::memory_order_relaxed);
+        auto *base = reinterpret_cast<char *>(header_) + HeaderStride();
+        auto *slot = reinterpret_cast<EventTapSlot *>(base + (seq % header_->num_slots) * slot_stride_);
+
+        slot->seq.store(2 * seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->event_count = event_count;
+        slot->timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::system_clock::now().time_since_epoch()).count();
+        slot->num_words = static_cast<uint32_t>(num_words);
+        std::memcpy(reinterpret_cast<char *>(slot) + sizeof(EventTapSlot), words, num_words * sizeof(uint32_t));
+
+        slot->seq.store(2 * seq + 2, std::memory_order_release);
+        header_->write_seq.store(seq + 1, std::memory_order_release);
+        return true;
+    }
+
+    EventTapReader::~EventTapReader() {
+        Detach();
+    }
+
+    bool EventTapReader::Attach(const std::string &name) {
+        Detach();
+        const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1) return false;
+
+        struct stat shm_stat{};
+        if (fstat(fd, &shm_stat) == -1 || static_cast<size_t>(shm_stat.st_size) < HeaderStride()) {
+            close(fd);
+            return false;
+        }
+        map_size_ = static_cast<size_t>(shm_stat.st_size);
+        void *addr = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) return false;
+
+        header_ = static_cast<const EventTapHeader *>(addr);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header_->magic != EventTapHeader::kMagic || header_->version != EventTapHeader::kVersion ||
+            HeaderStride() + header_->num_slots * SlotStride(header_->slot_words) > map_size_) {
+            Detach();
+            return false;
+        }
+        slot_stride_ = SlotStride(header_->slot_words);
+        // Start from the newest events rather than replaying the whole ring
+        read_seq_ = header_->write_seq.load(std::memory_order_acquire);
+        num_missed_ = 0;
+        return true;
+    }
+
+    void EventTapReader::Detach() {
+        if (header_ == nullptr) return;
+        munmap(const_cast<EventTapHeader *>(header_), map_size_);
+        header_ = nullptr;
+        map_size_ = 0;
+    }
+
+    bool EventTapReader::ReadNext(std::vector<uint32_t> &event, uint64_t &event_count) {
+        if (header_ == nullptr) return false;
+
+        const uint64_t write_seq = header_->write_seq.load(std::memory_order_acquire);
+        if (read_seq_ >= write_seq) return false;
+        // Lapped by the writer, skip to the oldest event which has not been overwritten
+        if (write_seq - read_seq_ > header_->num_slots) {
+            num_missed_ += write_seq - read_seq_ - header_->num_slots;
+            read_seq_ = write_seq - header_->num_slots;
+        }
+
+        const auto *base = reinterpret_cast<const char *>(header_) + HeaderStride();
+        const auto *slot = reinterpret_cast<const EventTapSlot *>(base + (read_seq_ % header_->num_slots) * slot_stride_);
+
+        const uint64_t expected_seq = 2 * read_seq_ + 2;
+        if (slot->seq.load(std::memory_order_acquire) != expected_seq) {
+            num_missed_++;
+            read_seq_++;
+            return false;
+        }
+        const uint32_t num_words = std::min(slot->num_words, header_->slot_words);
+        event.resize(num_words);
+        event_count = slot->event_count;
+        std::memcpy(event.data(), reinterpret_cast<const char *>(slot) + sizeof(EventTapSlot), num_words * sizeof(uint32_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // If the writer started on this slot while we copied, the copy is torn and dropped
+        read_seq_++;
+        if (slot->seq.load(std::memory_order_relaxed) != expected_seq) {
+            num_missed_++;
+            return false;
+        }
+        return true;
+    }
+
+} // data_handler
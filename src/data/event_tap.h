@@ -0,0 +1,96 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef EVENT_TAP_H
+#define EVENT_TAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace data_handler {
+
+/*
+ * A lossy shared memory ring (POSIX shm) used to give the data monitor a live view of the
+ * events without re-reading the data files from disk.
+ *
+ * The write thread publishes a sample of the complete events into a fixed number of slots,
+ * overwriting the oldest one. It never waits on a reader, each slot is protected by a sequence
+ * number (odd while being written) so a reader can tell if the slot was overwritten while it
+ * was copying it. Any number of readers can attach by name, each keeps its own position in the
+ * ring and counts the events it missed.
+ */
+
+constexpr char kDefaultEventTapName[] = "/grams_tpc_event_tap";
+
+struct EventTapHeader {
+    static constexpr uint32_t kMagic = 0x50415447; // "GTAP"
+    static constexpr uint32_t kVersion = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t slot_words;
+    std::atomic<uint64_t> write_seq; // number of events published
+};
+
+struct EventTapSlot {
+    std::atomic<uint64_t> seq; // 2*n+1 while writing event n, 2*n+2 once complete
+    uint64_t event_count;
+    uint64_t timestamp_ns;
+    uint32_t num_words;
+    uint32_t reserved;
+    // followed by `slot_words` 32b data words
+};
+
+class EventTapWriter {
+public:
+
+    EventTapWriter() = default;
+    ~EventTapWriter();
+
+    bool Open(const std::string &name, size_t num_slots, size_t slot_words);
+    void Close();
+    bool IsOpen() const { return header_ != nullptr; }
+
+    // Copy an event into the next slot, returns false if it does not fit
+    bool Publish(const uint32_t *words, size_t num_words, uint64_t event_count);
+
+private:
+
+    std::string name_;
+    EventTapHeader *header_ = nullptr;
+    size_t map_size_ = 0;
+    size_t slot_stride_ = 0;
+};
+
+class EventTapReader {
+public:
+
+    EventTapReader() = default;
+    ~EventTapReader();
+
+    bool Attach(const std::string &name);
+    void Detach();
+    bool IsAttached() const { return header_ != nullptr; }
+
+    // Copy the next available event, returns false if there is no new event.
+    // If the writer lapped us we skip ahead to the oldest event still in the ring.
+    bool ReadNext(std::vector<uint32_t> &event, uint64_t &event_count);
+    size_t NumMissed() const { return num_missed_; }
+
+private:
+
+    const EventTapHeader *header_ = nullptr;
+    size_t map_size_ = 0;
+    size_t slot_stride_ = 0;
+    uint64_t read_seq_ = 0;
+    size_t num_missed_ = 0;
+};
+
+} // data_handler
+
+#endif //EVENT_TAP_H
@@ -0,0 +1,173 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "fem_data_validator.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace data_handler {
+
+    void FemDataValidator::Reset() {
+        for (auto &counters : fem_counters_) {
+            counters.num_headers.store(0);
+            counters.event_gaps.store(0);
+            counters.word_count_errors.store(0);
+            counters.checksum_errors.store(0);
+        }
+        last_event_number_.fill(0);
+        has_last_event_.fill(false);
+        num_events_checked_.store(0);
+        num_bad_events_.store(0);
+        missing_header_errors_.store(0);
+    }
+
+    FemDataValidator::FemHeader FemDataValidator::DecodeHeader(const uint32_t *header) {
+        FemHeader fem_header{};
+        const uint32_t module_word = (header[0] >> 16) & 0xFFF;
+        fem_header.module = module_word & 0x1F;
+        fem_header.id = (module_word >> 5) & 0x7F;
+        fem_header.word_count = HeaderValue(header[1]);
+        fem_header.event_number = HeaderValue(header[2]);
+        fem_header.frame_number = HeaderValue(header[3]);
+        fem_header.checksum = HeaderValue(header[4]);
+        return fem_header;
+    }
+
+    size_t FemDataValidator::FindNextHeader(const uint32_t *words, size_t begin, const size_t end) {
+#ifdef __SSE2__
+        // Compare 4 words at a time against the header marker, only drop to the scalar
+        // check once a block has a candidate.
+        const __m128i low_mask = _mm_set1_epi32(0xFFFF);
+        const __m128i all_ones = _mm_set1_epi32(-1);
+        for (; begin + 4 <= end; begin += 4) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + begin));
+            const __m128i is_marker = _mm_cmpeq_epi32(_mm_and_si128(block, low_mask), low_mask);
+            const __m128i is_start = _mm_cmpeq_epi32(block, all_ones);
+            if (_mm_movemask_epi8(_mm_andnot_si128(is_start, is_marker)) != 0) break;
+        }
+#endif
+        for (; begin < end; begin++) {
+            if (isFemHeader(words[begin])) return begin;
+        }
+        return end;
+    }
+
+    size_t FemDataValidator::RemoveModules(uint32_t *words, const size_t num_words, const uint32_t first_module,
+                                           const uint32_t last_module) {
+        size_t header_idx = FindNextHeader(words, 0, num_words);
+        size_t out_idx = header_idx;
+        while (header_idx < num_words) {
+            const size_t payload_begin = std::min(header_idx + kHeaderWords, num_words);
+            const size_t next_header = FindNextHeader(words, payload_begin, num_words);
+            // A truncated header at the end of the event is kept as is
+            const bool is_removed = (payload_begin - header_idx) == kHeaderWords &&
+                                    DecodeHeader(words + header_idx).module >= first_module &&
+                                    DecodeHeader(words + header_idx).module <= last_module;
+            if (!is_removed) {
+                std::memmove(words + out_idx, words + header_idx, (next_header - header_idx) * sizeof(uint32_t));
+                out_idx += next_header - header_idx;
+            }
+            header_idx = next_header;
+        }
+        return out_idx;
+    }
+
+    uint32_t FemDataValidator::ComputeChecksum(const uint32_t *words, const size_t num_words) {
+        uint64_t sum = 0;
+        size_t i = 0;
+#ifdef __SSE2__
+        // Add both 16b halves of 4 words at a time, widening to 64b lanes so nothing overflows
+        const __m128i low_mask = _mm_set1_epi32(0xFFFF);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum64 = _mm_setzero_si128();
+        for (; i + 4 <= num_words; i += 4) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + i));
+            const __m128i halves = _mm_add_epi32(_mm_and_si128(block, low_mask), _mm_srli_epi32(block, 16));
+            sum64 = _mm_add_epi64(sum64, _mm_unpacklo_epi32(halves, zero));
+            sum64 = _mm_add_epi64(sum64, _mm_unpackhi_epi32(halves, zero));
+        }
+        alignas(16) uint64_t lanes[2];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), sum64);
+        sum = lanes[0] + lanes[1];
+#endif
+        for (; i < num_words; i++) {
+            sum += (words[i] & 0xFFFF) + (words[i] >> 16);
+        }
+        return static_cast<uint32_t>(sum & 0xFFFFFF);
+    }
+
+    void FemDataValidator::CheckEvent(const uint32_t *words, const size_t num_words) {
+        if (!enable_) return;
+        num_events_checked_++;
+        bool is_bad_event = false;
+
+        size_t header_idx = FindNextHeader(words, 0, num_words);
+        if (header_idx == num_words) {
+            missing_header_errors_++;
+            num_bad_events_++;
+            return;
+        }
+
+        while (header_idx < num_words) {
+            if ((header_idx + kHeaderWords) > num_words) {
+                missing_header_errors_++; // truncated header
+                is_bad_event = true;
+                break;
+            }
+            const FemHeader header = DecodeHeader(words + header_idx);
+            const size_t payload_begin = header_idx + kHeaderWords;
+            const size_t next_header = FindNextHeader(words, payload_begin, num_words);
+            const size_t payload_words = next_header - payload_begin;
+            FemCounters &counters = fem_counters_[header.module];
+            counters.num_headers++;
+
+            // The word count is in 16b words, the payload is packed 2 per 32b word
+            if (((header.word_count + 1) / 2) != payload_words) {
+                counters.word_count_errors++;
+                is_bad_event = true;
+            }
+            if (ComputeChecksum(words + payload_begin, payload_words) != header.checksum) {
+                counters.checksum_errors++;
+                is_bad_event = true;
+            }
+            // Event number is 24b so let it roll over
+            if (has_last_event_[header.module] &&
+                header.event_number != ((last_event_number_[header.module] + 1) & 0xFFFFFF)) {
+                counters.event_gaps++;
+                is_bad_event = true;
+            }
+            last_event_number_[header.module] = header.event_number;
+            has_last_event_[header.module] = true;
+
+            header_idx = next_header;
+        }
+        if (is_bad_event) num_bad_events_++;
+    }
+
+    void FemDataValidator::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        size_t event_gaps = 0, word_count_errors = 0, checksum_errors = 0;
+        for (size_t module = 0; module < kMaxModules; module++) {
+            const FemCounters &counters = fem_counters_[module];
+            if (counters.num_headers.load() == 0) continue;
+            const std::string prefix = "fem" + std::to_string(module) + "_";
+            metrics[prefix + "event_gaps"] = counters.event_gaps.load();
+            metrics[prefix + "word_count_errors"] = counters.word_count_errors.load();
+            metrics[prefix + "checksum_errors"] = counters.checksum_errors.load();
+            event_gaps += counters.event_gaps.load();
+            word_count_errors += counters.word_count_errors.load();
+            checksum_errors += counters.checksum_errors.load();
+        }
+        metrics["fem_events_checked"] = num_events_checked_.load();
+        metrics["fem_bad_events"] = num_bad_events_.load();
+        metrics["fem_missing_headers"] = missing_header_errors_.load();
+        metrics["fem_event_gaps"] = event_gaps;
+        metrics["fem_word_count_errors"] = word_count_errors;
+        metrics["fem_checksum_errors"] = checksum_errors;
+    }
+
+} // data_handler
@@ -0,0 +1,99 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef FEM_DATA_VALIDATOR_H
+#define FEM_DATA_VALIDATOR_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace data_handler {
+
+/*
+ * Decodes the FEM headers of each event in the write path and checks the data integrity.
+ *
+ * Each FEM sub-event starts with a 6 word header, each 32b word holds two 16b words where
+ * the values are split as 12b halves, see `ReadoutViaController` for the slow readout
+ * equivalent.
+ *  word 0: 0xFFFF header marker | module address (5b) + id (7b)
+ *  word 1: number of 16b data words following the header
+ *  word 2: event number
+ *  word 3: frame number
+ *  word 4: checksum, 24b sum of the 16b data words
+ *  word 5: trigger frame and sample
+ *
+ * The headers are found by scanning for the 0xFFFF marker (SSE2 when available) and the
+ * payload of a FEM is everything up to the next header or the end of the event. This way a
+ * corrupt word count is flagged without throwing off the parsing of the rest of the event.
+ *
+ * `CheckEvent()` is called from the write thread only, the counters can be read from any thread.
+ */
+class FemDataValidator {
+public:
+
+    FemDataValidator() = default;
+    ~FemDataValidator() = default;
+
+    struct FemHeader {
+        uint32_t module;
+        uint32_t id;
+        uint32_t word_count;
+        uint32_t event_number;
+        uint32_t frame_number;
+        uint32_t checksum;
+    };
+
+    void SetEnable(const bool enable) { enable_ = enable; }
+    bool IsEnabled() const { return enable_; }
+    void Reset();
+
+    // Check the words between the event start and end markers (exclusive)
+    void CheckEvent(const uint32_t *words, size_t num_words);
+
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+    static FemHeader DecodeHeader(const uint32_t *header);
+    static uint32_t ComputeChecksum(const uint32_t *words, size_t num_words);
+    static size_t FindNextHeader(const uint32_t *words, size_t begin, size_t end);
+    // Drop the sub-events of the modules in [first_module, last_module] in place, returns the new number of words
+    static size_t RemoveModules(uint32_t *words, size_t num_words, uint32_t first_module, uint32_t last_module);
+
+    static constexpr size_t kHeaderWords = 6;
+    static constexpr size_t kMaxModules = 32;
+
+    static bool isFemHeader(const uint32_t word) {
+        return ((word & 0xFFFF) == 0xFFFF) && (word != 0xFFFFFFFF);
+    }
+    // Combine the two 12b halves of a header word, the upper half is the lower 16b
+    static uint32_t HeaderValue(const uint32_t word) {
+        return ((word >> 16) & 0xFFF) + ((word & 0xFFF) << 12);
+    }
+
+private:
+
+    struct FemCounters {
+        std::atomic<size_t> num_headers = 0;
+        std::atomic<size_t> event_gaps = 0;
+        std::atomic<size_t> word_count_errors = 0;
+        std::atomic<size_t> checksum_errors = 0;
+    };
+
+    bool enable_ = true;
+    std::array<FemCounters, kMaxModules> fem_counters_{};
+    // Only accessed by the write thread
+    std::array<uint32_t, kMaxModules> last_event_number_{};
+    std::array<bool, kMaxModules> has_last_event_{};
+
+    std::atomic<size_t> num_events_checked_ = 0;
+    std::atomic<size_t> num_bad_events_ = 0;
+    std::atomic<size_t> missing_header_errors_ = 0;
+};
+
+} // data_handler
+
+#endif //FEM_DATA_VALIDATOR_H
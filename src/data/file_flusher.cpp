@@ -0,0 +1,171 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "file_flusher.h"
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace data_handler {
+
+    namespace {
+        uint64_t SteadyNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    FileFlusher::File::~File() {
+        if (fd != -1) close(fd);
+    }
+
+    FileFlusher::~FileFlusher() {
+        Stop();
+    }
+
+    void FileFlusher::Configure(const size_t interval_bytes, const size_t interval_ms) {
+        interval_bytes_ = interval_bytes;
+        interval_ns_ = std::max(interval_ms, size_t{1}) * 1000000ULL;
+    }
+
+    bool FileFlusher::Start() {
+        Stop();
+        if (!IsEnabled()) return false;
+        stop_ = false;
+        pending_ = false;
+        thread_ = std::thread(&FileFlusher::FlusherLoop, this);
+        return true;
+    }
+
+    void FileFlusher::Stop() {
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+        files_.clear();
+    }
+
+    void FileFlusher::ResetCounters() {
+        bytes_written_.store(0);
+        bytes_durable_.store(0);
+        max_unsynced_bytes_.store(0);
+        sync_ns_.store(0);
+        num_errors_.store(0);
+    }
+
+    std::shared_ptr<FileFlusher::File> FileFlusher::Attach(const int fd) {
+        if (!IsRunning() || fd == -1) return nullptr;
+        auto file = std::make_shared<File>();
+        file->fd = dup(fd);
+        if (file->fd == -1) {
+            num_errors_++;
+            return nullptr;
+        }
+        file->last_flush_ns = SteadyNs();
+        std::lock_guard<std::mutex> lock(mutex_);
+        files_.push_back(file);
+        return file;
+    }
+
+    void FileFlusher::Written(const std::shared_ptr<File> &file, const uint64_t offset) {
+        if (!file) return;
+        const uint64_t previous = file->written.exchange(offset);
+        if (offset > previous) bytes_written_.fetch_add(offset - previous, std::memory_order_relaxed);
+        // Only wake the thread when another interval has been written
+        if ((previous / interval_bytes_) != (offset / interval_bytes_)) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_ = true;
+            }
+            cv_.notify_one();
+        }
+    }
+
+    void FileFlusher::Detach(const std::shared_ptr<File> &file, const uint64_t offset) {
+        if (!file) return;
+        Written(file, offset);
+        file->closing.store(true);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    void FileFlusher::Flush(File &file, const bool force, const uint64_t now) {
+        const uint64_t written = file.written.load();
+        if (!force && (written - file.submitted) < interval_bytes_ && (now - file.last_flush_ns) < interval_ns_) return;
+        if (written == file.durable) return;
+
+        const uint64_t sync_start = SteadyNs();
+        max_unsynced_bytes_.store(std::max(max_unsynced_bytes_.load(std::memory_order_relaxed), written - file.durable),
+                                  std::memory_order_relaxed);
+        // Start the writeback of the new range, then wait for the one started on the last pass.
+        // When forced the new range is waited on as well.
+        if (written > file.submitted) {
+            if (sync_file_range(file.fd, static_cast<off_t>(file.submitted), static_cast<off_t>(written - file.submitted),
+                                SYNC_FILE_RANGE_WRITE) == -1) num_errors_++;
+        }
+        const uint64_t wait_end = force ? written : file.submitted;
+        if (wait_end > file.durable) {
+            const auto begin = static_cast<off_t>(file.durable);
+            const auto length = static_cast<off_t>(wait_end - file.durable);
+            if (sync_file_range(file.fd, begin, length,
+                                SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == 0) {
+                // The data is on disk, no need to keep it in the page cache
+                posix_fadvise(file.fd, begin, length, POSIX_FADV_DONTNEED);
+                bytes_durable_.fetch_add(wait_end - file.durable, std::memory_order_relaxed);
+                file.durable = wait_end;
+            } else {
+                num_errors_++;
+            }
+        }
+        file.submitted = written;
+        file.last_flush_ns = now;
+        sync_ns_.fetch_add(SteadyNs() - sync_start, std::memory_order_relaxed);
+    }
+
+    void FileFlusher::FlusherLoop() {
+        while (true) {
+            std::vector<std::shared_ptr<File>> files;
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait_for(lock, std::chrono::nanoseconds(interval_ns_), [this] { return stop_ || pending_; });
+                pending_ = false;
+                stopping = stop_;
+                files = files_;
+            }
+
+            const uint64_t now = SteadyNs();
+            std::vector<std::shared_ptr<File>> closed;
+            for (const auto &file : files) {
+                const bool closing = file->closing.load();
+                Flush(*file, stopping || closing, now);
+                if (closing) closed.push_back(file);
+            }
+
+            if (!closed.empty()) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                files_.erase(std::remove_if(files_.begin(), files_.end(), [&closed](const std::shared_ptr<File> &file) {
+                    return std::find(closed.begin(), closed.end(), file) != closed.end();
+                }), files_.end());
+            }
+            if (stopping) break;
+        }
+    }
+
+    void FileFlusher::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["written_mb"] = bytes_written_.load() / 1000000;
+        metrics["durable_mb"] = bytes_durable_.load() / 1000000;
+        metrics["max_unsynced_mb"] = max_unsynced_bytes_.load() / 1000000;
+        metrics["sync_time_ms"] = sync_ns_.load() / 1000000;
+        metrics["sync_errors"] = num_errors_.load();
+    }
+
+} // data_handler
@@ -0,0 +1,94 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef FILE_FLUSHER_H
+#define FILE_FLUSHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace data_handler {
+
+/*
+ * Background thread making the data files durable as they are written, instead of relying
+ * on the fsync when the file is closed.
+ *
+ * Writers report how far they have written a file and every `interval_bytes` (or at least
+ * every `interval_ms`) the new range is handed to the kernel with sync_file_range(WRITE),
+ * while the range started on the previous pass is waited on (WAIT_BEFORE|WRITE|WAIT_AFTER)
+ * and dropped from the page cache. The writeback is pipelined behind the writer and at most
+ * about two intervals of data can be lost in a power cut. The fsync at close then only
+ * has a small tail left to write. File metadata is left to the fsync on close.
+ *
+ * Each attached file holds a dup of the writer's fd so the writer can close its fd at any
+ * time. A detached file gets a last flush before its fd is released.
+ */
+class FileFlusher {
+public:
+
+    struct File {
+        ~File();
+        int fd = -1;
+        std::atomic<uint64_t> written = 0;
+        std::atomic<bool> closing = false;
+        // Only accessed by the flusher thread
+        uint64_t submitted = 0;
+        uint64_t durable = 0;
+        uint64_t last_flush_ns = 0;
+    };
+
+    FileFlusher() = default;
+    ~FileFlusher();
+
+    void Configure(size_t interval_bytes, size_t interval_ms);
+    bool IsEnabled() const { return interval_bytes_ > 0; }
+
+    bool Start();
+    // Flushes the files still attached and joins the thread
+    void Stop();
+    bool IsRunning() const { return thread_.joinable(); }
+
+    // Track the file behind `fd`, nullptr if the flusher is not running
+    std::shared_ptr<File> Attach(int fd);
+    // The file has been written up to `offset`
+    void Written(const std::shared_ptr<File> &file, uint64_t offset);
+    // Flush whatever is left of the file and release it
+    void Detach(const std::shared_ptr<File> &file, uint64_t offset);
+
+    void ResetCounters();
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+private:
+
+    void FlusherLoop();
+    void Flush(File &file, bool force, uint64_t now);
+
+    size_t interval_bytes_ = 0;
+    uint64_t interval_ns_ = 2000000000;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    bool pending_ = false;
+    std::vector<std::shared_ptr<File>> files_;
+    std::thread thread_;
+
+    std::atomic<uint64_t> bytes_written_ = 0;
+    std::atomic<uint64_t> bytes_durable_ = 0;
+    std::atomic<uint64_t> max_unsynced_bytes_ = 0;
+    std::atomic<uint64_t> sync_ns_ = 0;
+    std::atomic<size_t> num_errors_ = 0;
+};
+
+} // data_handler
+
+#endif //FILE_FLUSHER_H
@@ -0,0 +1,127 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "loss_ledger.h"
+#include "json.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace data_handler {
+
+    void LossLedger::Reset() {
+        for (auto &count : counts_) count.store(0);
+        num_written_.store(0);
+        num_observed_.store(0);
+        first_event_number_.store(0);
+        last_event_number_.store(0);
+        has_event_number_ = false;
+        seen_.reset();
+        BeginFile();
+    }
+
+    const char *LossLedger::Name(const LossReason reason) {
+        switch (reason) {
+            case LossReason::kDmaAbort: return "dma_abort";
+            case LossReason::kQueueFull: return "queue_full";
+            case LossReason::kFemEventGap: return "fem_event_gap";
+            case LossReason::kOversizeEvent: return "oversize_event";
+            case LossReason::kTruncatedEvent: return "truncated_event";
+            case LossReason::kIncompleteEvent: return "incomplete_event";
+            case LossReason::kOversizeBuiltEvent: return "oversize_built_event";
+            case LossReason::kStoragePrescale: return "storage_prescale";
+            case LossReason::kWaveformPrescale: return "waveform_prescale";
+            case LossReason::kRunStop: return "run_stop";
+            case LossReason::kDownlinkFull: return "downlink_full";
+            case LossReason::kWriteFailed: return "write_failed";
+            case LossReason::kNumReasons: break;
+        }
+        return "unknown";
+    }
+
+    void LossLedger::ObserveEvent(const uint32_t fem_event_number) {
+        if (!has_event_number_) {
+            // One wrap up so a late event just before the first one stays positive
+            const uint64_t event_number = kEventNumberRange + (fem_event_number % kEventNumberRange);
+            has_event_number_ = true;
+            seen_.reset();
+            seen_[event_number % kWindow] = true;
+            first_event_number_.store(event_number, std::memory_order_relaxed);
+            last_event_number_.store(event_number, std::memory_order_relaxed);
+            num_observed_.fetch_add(1, std::memory_order_relaxed);
+        }
+        const uint64_t last = last_event_number_.load(std::memory_order_relaxed);
+        // Take the closest match to the newest event, either side of a wrap
+        int64_t diff = static_cast<int64_t>(fem_event_number % kEventNumberRange) -
+                       static_cast<int64_t>(last % kEventNumberRange);
+        if (diff >= static_cast<int64_t>(kEventNumberRange / 2)) diff -= kEventNumberRange;
+        if (diff < -static_cast<int64_t>(kEventNumberRange / 2)) diff += kEventNumberRange;
+        const uint64_t event_number = last + diff;
+
+        if (diff > 0) {
+            // Everything skipped over is missing until it turns up
+            const uint64_t begin = std::max(last + 1, event_number >= kWindow ? event_number - kWindow + 1 : 0);
+            for (uint64_t k = begin; k <= event_number; k++) seen_[k % kWindow] = k == event_number;
+            if (diff > 1) Record(LossReason::kFemEventGap, diff - 1);
+            last_event_number_.store(event_number, std::memory_order_relaxed);
+            num_observed_.fetch_add(1, std::memory_order_relaxed);
+        } else if (last - event_number < kWindow && event_number >= first_event_number_.load(std::memory_order_relaxed) &&
+                   !seen_[event_number % kWindow]) {
+            // A late event which was counted as missing
+            seen_[event_number % kWindow] = true;
+            counts_[static_cast<size_t>(LossReason::kFemEventGap)].fetch_sub(1, std::memory_order_relaxed);
+            num_observed_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (!file_has_event_) {
+            file_has_event_ = true;
+            file_first_event_number_ = event_number;
+        }
+    }
+
+    void LossLedger::BeginFile() {
+        for (size_t i = 0; i < kNumReasons; i++) file_start_counts_[i] = counts_[i].load(std::memory_order_relaxed);
+        file_start_written_ = num_written_.load(std::memory_order_relaxed);
+        file_start_observed_ = num_observed_.load(std::memory_order_relaxed);
+        file_has_event_ = false;
+    }
+
+    bool LossLedger::WriteFileSummary(const std::string &file_name, const uint64_t run_number,
+                                      const uint64_t subrun_number) const {
+        nlohmann::json summary;
+        summary["run"] = run_number;
+        summary["subrun"] = subrun_number;
+        summary["written_events"] = num_written_.load(std::memory_order_relaxed) - file_start_written_;
+        summary["observed_events"] = num_observed_.load(std::memory_order_relaxed) - file_start_observed_;
+        if (file_has_event_) {
+            summary["fem_first_event"] = file_first_event_number_ % kEventNumberRange;
+            summary["fem_last_event"] = last_event_number_.load(std::memory_order_relaxed) % kEventNumberRange;
+        }
+        for (size_t i = 0; i < kNumReasons; i++) {
+            summary["losses"][Name(static_cast<LossReason>(i))] =
+                    static_cast<int64_t>(counts_[i].load(std::memory_order_relaxed) - file_start_counts_[i]);
+        }
+
+        std::ofstream file(file_name + kSummarySuffix, std::ios::out | std::ios::trunc);
+        if (!file.is_open()) return false;
+        file << summary.dump() << "\n";
+        return file.good();
+    }
+
+    void LossLedger::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        for (size_t i = 0; i < kNumReasons; i++) {
+            metrics[std::string("loss_") + Name(static_cast<LossReason>(i))] = counts_[i].load(std::memory_order_relaxed);
+        }
+        const uint64_t num_written = num_written_.load(std::memory_order_relaxed);
+        metrics["loss_written_events"] = num_written;
+        metrics["loss_observed_events"] = num_observed_.load(std::memory_order_relaxed);
+
+        // Every FEM event number between the first and the newest was a trigger
+        const uint64_t first = first_event_number_.load(std::memory_order_relaxed);
+        const uint64_t last = last_event_number_.load(std::memory_order_relaxed);
+        const uint64_t num_triggered = first > 0 ? last - first + 1 : 0;
+        metrics["loss_triggered_events"] = num_triggered;
+        metrics["loss_live_fraction_ppm"] = num_triggered > 0 ? std::min(num_written, num_triggered) * 1000000 / num_triggered : 0;
+    }
+
+} // data_handler
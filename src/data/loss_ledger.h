@@ -0,0 +1,105 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef LOSS_LEDGER_H
+#define LOSS_LEDGER_H
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace data_handler {
+
+enum class LossReason : uint8_t {
+    kDmaAbort = 0,       // DMA buffers cut short by an abort, the rest of the buffer is lost
+    kQueueFull,          // DMA buffers dropped as the read/write queue was full
+    kFemEventGap,        // FEM event numbers which never reached the write thread
+    kOversizeEvent,      // events dropped as bigger than the event buffer
+    kTruncatedEvent,     // events without an end marker, dropped at the next start marker
+    kIncompleteEvent,    // built events released without every expected module (kept)
+    kOversizeBuiltEvent, // built events dropped as bigger than the event buffer
+    kStoragePrescale,    // events not written in the reduced data mode
+    kWaveformPrescale,   // events kept as trigger primitives only
+    kRunStop,            // partial event left over at the end of the run
+    kDownlinkFull,       // events left out of the downlink stream as its queue was full
+    kWriteFailed,        // events in blocks which couldn't be written to their data file
+    kNumReasons
+};
+
+/*
+ * End to end accounting of the data which doesn't make it into the files, by reason. The
+ * DMA reasons count buffers, kFemEventGap missing FEM event numbers and the rest events.
+ * kDownlinkFull only concerns the downlink stream, the events are still in the data files.
+ *
+ * The FEM event number of every event that reaches the write thread is followed (24b,
+ * unwrapped) so the events lost before it, whichever the reason, show up as gaps. Numbers
+ * which arrive late, up to kWindow behind the newest, are taken off the gap count again so the
+ * event builder reordering doesn't count as a loss. With the written event count this gives
+ * the live fraction of the run.
+ *
+ * Each data file gets a summary of what was lost while it was open, written next to it as
+ * <file>.loss (json). `Record()` can be called from any thread, the event and file tracking
+ * from the write thread only.
+ */
+class LossLedger {
+public:
+
+    LossLedger() = default;
+    ~LossLedger() = default;
+
+    void Reset();
+
+    void Record(LossReason reason, uint64_t count = 1) {
+        counts_[static_cast<size_t>(reason)].fetch_add(count, std::memory_order_relaxed);
+    }
+    uint64_t Count(LossReason reason) const {
+        return counts_[static_cast<size_t>(reason)].load(std::memory_order_relaxed);
+    }
+    static const char *Name(LossReason reason);
+
+    // The FEM event number of an event as it reached the write thread, repeats (the sub-events
+    // of a built event) are only counted once
+    void ObserveEvent(uint32_t fem_event_number);
+    // An event was written out
+    void CountWritten() { num_written_.fetch_add(1, std::memory_order_relaxed); }
+
+    // Start the counts of a new file, write the summary of the file just finished
+    void BeginFile();
+    bool WriteFileSummary(const std::string &file_name, uint64_t run_number, uint64_t subrun_number) const;
+
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+    static constexpr char kSummarySuffix[] = ".loss";
+
+private:
+
+    static constexpr size_t kNumReasons = static_cast<size_t>(LossReason::kNumReasons);
+    static constexpr uint64_t kWindow = 4096;
+    static constexpr uint64_t kEventNumberRange = 1ULL << 24;
+
+    std::array<std::atomic<uint64_t>, kNumReasons> counts_{};
+    std::atomic<uint64_t> num_written_ = 0;
+    std::atomic<uint64_t> num_observed_ = 0;
+    std::atomic<uint64_t> first_event_number_ = 0;
+    std::atomic<uint64_t> last_event_number_ = 0;
+
+    // Write thread only
+    bool has_event_number_ = false;
+    std::bitset<kWindow> seen_;
+
+    // Counts at the start of the current file
+    std::array<uint64_t, kNumReasons> file_start_counts_{};
+    uint64_t file_start_written_ = 0;
+    uint64_t file_start_observed_ = 0;
+    uint64_t file_first_event_number_ = 0;
+    bool file_has_event_ = false;
+};
+
+} // data_handler
+
+#endif //LOSS_LEDGER_H
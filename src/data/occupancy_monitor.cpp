@@ -0,0 +1,182 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "occupancy_monitor.h"
+#include "fem_data_validator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace data_handler {
+
+    namespace {
+        constexpr uint16_t kChannelStart = 0x4000;
+        constexpr uint16_t kChannelEnd = 0x5000;
+        constexpr uint16_t kMarkerMask = 0xF000;
+
+        uint64_t SteadyNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    void OccupancyMonitor::Configure(const bool enable, const size_t prescale, const uint32_t threshold,
+                                     const size_t publish_period_ms, const double noisy_factor,
+                                     const uint32_t module_mask, const uint32_t light_mask) {
+        enable_ = enable;
+        prescale_ = std::max(prescale, size_t{1});
+        threshold_ = threshold;
+        publish_period_ns_ = std::max(publish_period_ms, size_t{1}) * 1000000ULL;
+        noisy_factor_ = noisy_factor;
+        module_mask_ = module_mask;
+        light_mask_ = light_mask;
+    }
+
+    void OccupancyMonitor::Reset() {
+        hits_.fill(0);
+        over_threshold_.fill(0);
+        num_channels_.fill(0);
+        period_start_ns_ = SteadyNs();
+        period_events_ = 0;
+        {
+            std::lock_guard<std::mutex> lock(publish_mutex_);
+            published_hits_.fill(0);
+            published_over_threshold_.fill(0);
+            published_channels_.fill(0);
+            published_events_ = 0;
+        }
+        num_sampled_events_.store(0);
+        num_published_.store(0);
+    }
+
+    void OccupancyMonitor::SampleEvent(const uint32_t *words, const size_t num_words, const size_t event_number) {
+        if (!enable_ || (event_number % prescale_) != 0) return;
+        num_sampled_events_++;
+        period_events_++;
+
+        size_t header_idx = FemDataValidator::FindNextHeader(words, 0, num_words);
+        while (header_idx + FemDataValidator::kHeaderWords <= num_words) {
+            const FemDataValidator::FemHeader header = FemDataValidator::DecodeHeader(words + header_idx);
+            const size_t payload_begin = header_idx + FemDataValidator::kHeaderWords;
+            const size_t next_header = FemDataValidator::FindNextHeader(words, payload_begin, num_words);
+            const size_t payload_words = next_header - payload_begin;
+            if (((module_mask_ >> header.module) & 0x1) && ((header.word_count + 1) / 2) == payload_words) {
+                halves_.resize(2 * payload_words);
+                std::memcpy(halves_.data(), words + payload_begin, payload_words * sizeof(uint32_t));
+                CountFem(header.module, halves_.data(), header.word_count);
+            }
+            header_idx = next_header;
+        }
+        Update(false);
+    }
+
+    void OccupancyMonitor::CountFem(const uint32_t module, const uint16_t *halves, const size_t num_halves) {
+        const bool is_light = (light_mask_ >> module) & 0x1;
+        uint32_t *hits = hits_.data() + module * kMaxChannels;
+        uint32_t *over_threshold = over_threshold_.data() + module * kMaxChannels;
+        size_t i = 0;
+        while (i < num_halves) {
+            if ((halves[i] & kMarkerMask) != kChannelStart) {
+                i++;
+                continue;
+            }
+            const uint32_t channel = halves[i] & 0x3F;
+            const size_t start = i + 1;
+            size_t end = start;
+            while (end < num_halves && (halves[end] & kMarkerMask) == 0) end++;
+            i = end;
+            // Only plain 12b samples of a channel which ends where it should
+            if (end == num_halves || halves[end] != (kChannelEnd | channel)) continue;
+
+            const uint16_t *samples = halves + start;
+            const size_t num_samples = end - start;
+            num_channels_[module] = std::max(num_channels_[module], static_cast<uint16_t>(channel + 1));
+            const size_t num_baseline = std::min(num_samples, kBaselineSamples);
+            uint32_t baseline_sum = 0;
+            for (size_t s = 0; s < num_baseline; s++) baseline_sum += samples[s];
+            const int baseline = num_baseline > 0 ? static_cast<int>(baseline_sum / num_baseline) : 0;
+            uint32_t count = 0;
+            for (size_t s = 0; s < num_samples; s++) {
+                const int deviation = static_cast<int>(samples[s]) - baseline;
+                count += static_cast<uint32_t>(deviation > static_cast<int>(threshold_) ||
+                                               deviation < -static_cast<int>(threshold_));
+            }
+            over_threshold[channel] += count;
+            hits[channel] += static_cast<uint32_t>(is_light || count > 0);
+        }
+    }
+
+    void OccupancyMonitor::Update(const bool force) {
+        if (!enable_) return;
+        if (!force && (SteadyNs() - period_start_ns_) < publish_period_ns_) return;
+        if (period_events_ > 0) Publish();
+        period_start_ns_ = SteadyNs();
+    }
+
+    void OccupancyMonitor::Publish() {
+        {
+            std::lock_guard<std::mutex> lock(publish_mutex_);
+            published_hits_ = hits_;
+            published_over_threshold_ = over_threshold_;
+            published_channels_ = num_channels_;
+            published_events_ = period_events_;
+        }
+        hits_.fill(0);
+        over_threshold_.fill(0);
+        num_channels_.fill(0);
+        period_events_ = 0;
+        num_published_++;
+    }
+
+    std::vector<uint32_t> OccupancyMonitor::GetHistogram() const {
+        std::vector<uint32_t> histogram;
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        for (uint32_t module = 0; module < kMaxModules; module++) {
+            const size_t num_channels = published_channels_[module];
+            if (num_channels == 0) continue;
+            histogram.push_back(module);
+            histogram.push_back(published_events_);
+            histogram.push_back(num_channels);
+            const uint32_t *hits = published_hits_.data() + module * kMaxChannels;
+            histogram.insert(histogram.end(), hits, hits + num_channels);
+        }
+        return histogram;
+    }
+
+    void OccupancyMonitor::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["occ_sampled_events"] = num_sampled_events_.load();
+        metrics["occ_histograms"] = num_published_.load();
+
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        if (published_events_ == 0) return;
+        std::array<uint32_t, kMaxChannels> sorted{};
+        for (uint32_t module = 0; module < kMaxModules; module++) {
+            const size_t num_channels = published_channels_[module];
+            if (num_channels == 0) continue;
+            const uint32_t *hits = published_hits_.data() + module * kMaxChannels;
+            const uint32_t *over_threshold = published_over_threshold_.data() + module * kMaxChannels;
+            uint64_t hit_sum = 0, over_threshold_sum = 0;
+            size_t dead = 0;
+            for (size_t ch = 0; ch < num_channels; ch++) {
+                hit_sum += hits[ch];
+                over_threshold_sum += over_threshold[ch];
+                dead += hits[ch] == 0;
+            }
+            std::copy(hits, hits + num_channels, sorted.begin());
+            std::nth_element(sorted.begin(), sorted.begin() + num_channels / 2, sorted.begin() + num_channels);
+            const double median = sorted[num_channels / 2];
+            size_t noisy = 0;
+            for (size_t ch = 0; ch < num_channels; ch++) {
+                noisy += hits[ch] > noisy_factor_ * std::max(median, 1.);
+            }
+
+            const std::string prefix = "occ_fem" + std::to_string(module) + "_";
+            metrics[prefix + "hits_per_kevt"] = hit_sum * 1000 / published_events_;
+            metrics[prefix + "over_thr_per_kevt"] = over_threshold_sum * 1000 / published_events_;
+            metrics[prefix + "dead"] = dead;
+            metrics[prefix + "noisy"] = noisy;
+        }
+    }
+
+} // data_handler
@@ -0,0 +1,97 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef OCCUPANCY_MONITOR_H
+#define OCCUPANCY_MONITOR_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace data_handler {
+
+/*
+ * Online channel occupancy of the charge and light FEMs, so dead or noisy channels show up
+ * within minutes instead of after the data has been downlinked.
+ *
+ * Every `prescale`th event is sampled. For each channel waveform (0x4000|ch samples...
+ * 0x5000|ch) the baseline is the mean of its first samples and every sample further than
+ * `threshold` from it is counted; a waveform with at least one such sample is a hit. The light
+ * FEM only sends the SiPM ROIs, framed the same way, so every light window is a hit.
+ *
+ * The counters are flat arrays indexed module * kMaxChannels + channel, owned by the write
+ * thread. Every `publish_period_ms` they are copied into the published histogram, read by the
+ * status thread, and start over, so each histogram covers one period:
+ *   occ_fem<N>_hits_per_kevt   hits per 1000 sampled events, summed over the channels
+ *   occ_fem<N>_over_thr_per_kevt samples over threshold per 1000 sampled events
+ *   occ_fem<N>_dead            channels without a single hit
+ *   occ_fem<N>_noisy           channels with more than `noisy_factor` x the module median hits
+ * `GetHistogram()` has the per channel hit counts, packed per module as
+ *   [module, num_events, num_channels, hits of channel 0, 1, ...]
+ */
+class OccupancyMonitor {
+public:
+
+    static constexpr size_t kMaxChannels = 64;
+    static constexpr size_t kMaxModules = 32;
+
+    OccupancyMonitor() = default;
+    ~OccupancyMonitor() = default;
+
+    // Only modules in `module_mask` are counted, those in `light_mask` as light FEMs
+    void Configure(bool enable, size_t prescale, uint32_t threshold, size_t publish_period_ms,
+                   double noisy_factor, uint32_t module_mask, uint32_t light_mask);
+    bool IsEnabled() const { return enable_; }
+    void Reset();
+
+    // Count the words between the event start and end markers (exclusive) if the event is due
+    void SampleEvent(const uint32_t *words, size_t num_words, size_t event_number);
+    // Publish the counters now if the period has passed, or always with `force`
+    void Update(bool force);
+
+    std::vector<uint32_t> GetHistogram() const;
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+private:
+
+    void CountFem(uint32_t module, const uint16_t *halves, size_t num_halves);
+    void Publish();
+
+    static constexpr size_t kBaselineSamples = 8;
+
+    bool enable_ = false;
+    size_t prescale_ = 10;
+    uint32_t threshold_ = 20;
+    uint64_t publish_period_ns_ = 1000000000ULL;
+    double noisy_factor_ = 5.;
+    uint32_t module_mask_ = 0;
+    uint32_t light_mask_ = 0;
+
+    // Write thread counters
+    std::array<uint32_t, kMaxModules * kMaxChannels> hits_{};
+    std::array<uint32_t, kMaxModules * kMaxChannels> over_threshold_{};
+    std::array<uint16_t, kMaxModules> num_channels_{};
+    std::vector<uint16_t> halves_;
+    uint64_t period_start_ns_ = 0;
+    uint32_t period_events_ = 0;
+
+    // Published histogram
+    mutable std::mutex publish_mutex_;
+    std::array<uint32_t, kMaxModules * kMaxChannels> published_hits_{};
+    std::array<uint32_t, kMaxModules * kMaxChannels> published_over_threshold_{};
+    std::array<uint16_t, kMaxModules> published_channels_{};
+    uint32_t published_events_ = 0;
+
+    std::atomic<size_t> num_sampled_events_ = 0;
+    std::atomic<size_t> num_published_ = 0;
+};
+
+} // data_handler
+
+#endif //OCCUPANCY_MONITOR_H
@@ -0,0 +1,254 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "pedestal_monitor.h"
+#include "fem_data_validator.h"
+#include "json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace data_handler {
+
+    namespace {
+        constexpr uint16_t kChannelStart = 0x4000;
+        constexpr uint16_t kChannelEnd = 0x5000;
+        constexpr uint16_t kMarkerMask = 0xF000;
+
+        uint64_t SteadyNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Chan et al. merge of two partial (n, mean, M2)
+        void Merge(uint64_t &n, double &mean, double &m2, const uint64_t n_b, const double mean_b, const double m2_b) {
+            if (n_b == 0) return;
+            const uint64_t n_ab = n + n_b;
+            const double delta = mean_b - mean;
+            mean += delta * static_cast<double>(n_b) / static_cast<double>(n_ab);
+            m2 += m2_b + delta * delta * static_cast<double>(n) * static_cast<double>(n_b) / static_cast<double>(n_ab);
+            n = n_ab;
+        }
+    }
+
+    void PedestalMonitor::Configure(const bool enable, const size_t prescale, const size_t window_samples,
+                                    const size_t snapshot_period_s, const uint32_t first_module,
+                                    const uint32_t last_module, const std::string &snapshot_file) {
+        enable_ = enable;
+        prescale_ = std::max(prescale, size_t{1});
+        window_samples_ = std::max(window_samples, size_t{1});
+        snapshot_period_ns_ = std::max(snapshot_period_s, size_t{1}) * 1000000000ULL;
+        first_module_ = first_module;
+        last_module_ = std::min(last_module, static_cast<uint32_t>(kMaxModules - 1));
+        snapshot_file_ = snapshot_file;
+    }
+
+    void PedestalMonitor::Reset() {
+        for (auto &module : accumulators_) module.fill(Accumulator{});
+        period_start_ns_ = SteadyNs();
+        period_events_ = 0;
+        {
+            std::lock_guard<std::mutex> lock(snapshot_mutex_);
+            snapshot_ = Snapshot{};
+            reference_ = Snapshot{};
+        }
+        num_sampled_events_.store(0);
+        num_snapshots_.store(0);
+        num_write_errors_.store(0);
+    }
+
+    void PedestalMonitor::SampleEvent(const uint32_t *words, const size_t num_words, const size_t event_number) {
+        if (!enable_ || (event_number % prescale_) != 0) return;
+        num_sampled_events_++;
+        period_events_++;
+
+        size_t header_idx = FemDataValidator::FindNextHeader(words, 0, num_words);
+        while (header_idx + FemDataValidator::kHeaderWords <= num_words) {
+            const FemDataValidator::FemHeader header = FemDataValidator::DecodeHeader(words + header_idx);
+            const size_t payload_begin = header_idx + FemDataValidator::kHeaderWords;
+            const size_t next_header = FemDataValidator::FindNextHeader(words, payload_begin, num_words);
+            const size_t payload_words = next_header - payload_begin;
+            // Only consistent charge FEM data, the word count is in 16b words
+            if (header.module >= first_module_ && header.module <= last_module_ &&
+                ((header.word_count + 1) / 2) == payload_words) {
+                halves_.resize(2 * payload_words);
+                std::memcpy(halves_.data(), words + payload_begin, payload_words * sizeof(uint32_t));
+                SampleFem(header.module, halves_.data(), header.word_count);
+            }
+            header_idx = next_header;
+        }
+        Update(false);
+    }
+
+    void PedestalMonitor::SampleFem(const uint32_t module, const uint16_t *halves, const size_t num_halves) {
+        size_t i = 0;
+        while (i < num_halves) {
+            if ((halves[i] & kMarkerMask) != kChannelStart) {
+                i++;
+                continue;
+            }
+            const uint32_t channel = halves[i] & 0x3F;
+            size_t end = i + 1;
+            while (end < num_halves && (halves[end] & kMarkerMask) == 0) end++;
+            // Only plain 12b samples of a channel which ends where it should, the suppressed and
+            // Huffman encoded formats are skipped
+            if (end < num_halves && halves[end] == (kChannelEnd | channel)) {
+                SampleChannel(accumulators_[module][channel], halves + i + 1, std::min(end - i - 1, window_samples_));
+            }
+            i = end;
+        }
+    }
+
+    void PedestalMonitor::SampleChannel(Accumulator &acc, const uint16_t *samples, const size_t num_samples) {
+        size_t s = 0;
+        uint64_t n = 0;
+        double mean = 0.;
+        double m2 = 0.;
+#ifdef __SSE2__
+        // Welford in 4 lanes, every lane has seen the same number of samples so the 1/n is shared
+        if (num_samples >= 8) {
+            __m128 lane_mean = _mm_setzero_ps();
+            __m128 lane_m2 = _mm_setzero_ps();
+            float lane_n = 0.f;
+            for (; s + 4 <= num_samples; s += 4) {
+                const __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(samples + s));
+                const __m128 x = _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, _mm_setzero_si128()));
+                lane_n += 1.f;
+                const __m128 delta = _mm_sub_ps(x, lane_mean);
+                lane_mean = _mm_add_ps(lane_mean, _mm_mul_ps(delta, _mm_set1_ps(1.f / lane_n)));
+                lane_m2 = _mm_add_ps(lane_m2, _mm_mul_ps(delta, _mm_sub_ps(x, lane_mean)));
+            }
+            alignas(16) float means[4];
+            alignas(16) float m2s[4];
+            _mm_store_ps(means, lane_mean);
+            _mm_store_ps(m2s, lane_m2);
+            for (size_t lane = 0; lane < 4; lane++) {
+                Merge(n, mean, m2, static_cast<uint64_t>(lane_n), means[lane], m2s[lane]);
+            }
+        }
+#endif
+        for (; s < num_samples; s++) {
+            n++;
+            const double delta = samples[s] - mean;
+            mean += delta / static_cast<double>(n);
+            m2 += delta * (samples[s] - mean);
+        }
+        Merge(acc.n, acc.mean, acc.m2, n, mean, m2);
+    }
+
+    void PedestalMonitor::Update(const bool force) {
+        if (!enable_) return;
+        if (!force && (SteadyNs() - period_start_ns_) < snapshot_period_ns_) return;
+        if (period_events_ > 0) TakeSnapshot();
+        period_start_ns_ = SteadyNs();
+    }
+
+    void PedestalMonitor::TakeSnapshot() {
+        Snapshot snapshot;
+        snapshot.time_s = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        snapshot.num_events = period_events_;
+        for (uint32_t module = first_module_; module <= last_module_; module++) {
+            const auto &channels = accumulators_[module];
+            const auto last = std::find_if(channels.rbegin(), channels.rend(),
+                                           [](const Accumulator &acc) { return acc.n > 0; });
+            const size_t num_channels = channels.rend() - last;
+            if (num_channels == 0) continue;
+            auto &mean = snapshot.mean[module];
+            auto &rms = snapshot.rms[module];
+            auto &num_samples = snapshot.num_samples[module];
+            for (size_t ch = 0; ch < num_channels; ch++) {
+                const Accumulator &acc = channels[ch];
+                mean.push_back(acc.mean);
+                rms.push_back(acc.n > 1 ? std::sqrt(acc.m2 / static_cast<double>(acc.n - 1)) : 0.);
+                num_samples.push_back(acc.n);
+            }
+        }
+        for (auto &module : accumulators_) module.fill(Accumulator{});
+        period_events_ = 0;
+
+        snapshot.number = num_snapshots_.load() + 1;
+        if (!snapshot_file_.empty() && !WriteSnapshot(snapshot)) num_write_errors_++;
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        if (reference_.number == 0) reference_ = snapshot;
+        snapshot_ = std::move(snapshot);
+        num_snapshots_++;
+    }
+
+    nlohmann::json PedestalMonitor::SnapshotJson(const Snapshot &snapshot) {
+        nlohmann::json table;
+        for (const auto &[module, mean] : snapshot.mean) {
+            const auto &rms = snapshot.rms.at(module);
+            const auto &num_samples = snapshot.num_samples.at(module);
+            auto &mean_json = table["mean"][std::to_string(module)];
+            auto &rms_json = table["rms"][std::to_string(module)];
+            // Channels without samples are null so they are not taken as a 0 pedestal
+            for (size_t ch = 0; ch < mean.size(); ch++) {
+                mean_json.push_back(num_samples[ch] > 0 ? nlohmann::json(mean[ch]) : nlohmann::json());
+                rms_json.push_back(num_samples[ch] > 0 ? nlohmann::json(rms[ch]) : nlohmann::json());
+            }
+        }
+        table["snapshot"] = snapshot.number;
+        table["time"] = snapshot.time_s;
+        table["events"] = snapshot.num_events;
+        return table;
+    }
+
+    bool PedestalMonitor::WriteSnapshot(const Snapshot &snapshot) const {
+        const nlohmann::json table = SnapshotJson(snapshot);
+        // Written next to the file and moved over it so a reader never sees half a table
+        const std::string tmp_file = snapshot_file_ + ".tmp";
+        {
+            std::ofstream file(tmp_file, std::ios::out | std::ios::trunc);
+            if (!file.is_open()) return false;
+            file << table.dump();
+            if (!file.good()) return false;
+        }
+        return std::rename(tmp_file.c_str(), snapshot_file_.c_str()) == 0;
+    }
+
+    PedestalMonitor::Snapshot PedestalMonitor::GetSnapshot() const {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        return snapshot_;
+    }
+
+    void PedestalMonitor::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["ped_sampled_events"] = num_sampled_events_.load();
+        metrics["ped_snapshots"] = num_snapshots_.load();
+        metrics["ped_write_errors"] = num_write_errors_.load();
+
+        // The metrics are integers, the baselines are sent in 0.1 and the RMS in 0.01 ADC counts
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        for (const auto &[module, mean] : snapshot_.mean) {
+            const auto &rms = snapshot_.rms.at(module);
+            const auto &num_samples = snapshot_.num_samples.at(module);
+            const auto ref = reference_.mean.find(module);
+            const auto ref_samples = reference_.num_samples.find(module);
+            double mean_sum = 0., rms_sum = 0., max_drift = 0.;
+            size_t num_channels = 0;
+            for (size_t ch = 0; ch < mean.size(); ch++) {
+                if (num_samples[ch] == 0) continue;
+                num_channels++;
+                mean_sum += mean[ch];
+                rms_sum += rms[ch];
+                if (ref != reference_.mean.end() && ch < ref->second.size() && ref_samples->second[ch] > 0) {
+                    max_drift = std::max(max_drift, std::abs(mean[ch] - ref->second[ch]));
+                }
+            }
+            if (num_channels == 0) continue;
+            const std::string prefix = "ped_fem" + std::to_string(module) + "_";
+            metrics[prefix + "mean_x10"] = static_cast<size_t>(10. * mean_sum / num_channels + 0.5);
+            metrics[prefix + "rms_x100"] = static_cast<size_t>(100. * rms_sum / num_channels + 0.5);
+            metrics[prefix + "max_drift_x10"] = static_cast<size_t>(10. * max_drift + 0.5);
+        }
+    }
+
+} // data_handler
@@ -0,0 +1,108 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef PEDESTAL_MONITOR_H
+#define PEDESTAL_MONITOR_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+namespace data_handler {
+
+/*
+ * Online pedestal and RMS of every charge channel, so baseline drift can be followed during
+ * the flight without a dedicated pedestal run.
+ *
+ * Every `prescale`th event is sampled, before it is zero suppressed. Of each channel waveform
+ * (0x4000|ch samples... 0x5000|ch) only the first `window_samples` samples are used, the
+ * baseline ahead of any pulse. The samples are accumulated with Welford's algorithm, 4 SIMD
+ * lanes at a time, the lanes are then merged into the channel's running mean and M2.
+ *
+ * Every `snapshot_period_s` the running values are published as a snapshot and the
+ * accumulators start over, so each snapshot covers one period. The snapshot summary goes out
+ * with the metrics, the full table can be read with `GetSnapshot()` and is written to
+ * `snapshot_file` (if set) as {"mean": {"<module>": [...]}, "rms": {...}} which can be loaded
+ * as a zero suppression pedestal table.
+ *
+ * Sampled from the write thread only, the snapshot can be read from any thread.
+ */
+class PedestalMonitor {
+public:
+
+    struct Snapshot {
+        uint64_t number = 0;
+        uint64_t time_s = 0;     // unix time the snapshot was taken
+        uint64_t num_events = 0; // events sampled in the period
+        std::map<uint32_t, std::vector<double>> mean; // per module, by channel
+        std::map<uint32_t, std::vector<double>> rms;
+        std::map<uint32_t, std::vector<uint64_t>> num_samples;
+    };
+
+    PedestalMonitor() = default;
+    ~PedestalMonitor() = default;
+
+    void Configure(bool enable, size_t prescale, size_t window_samples, size_t snapshot_period_s,
+                   uint32_t first_module, uint32_t last_module, const std::string &snapshot_file);
+    bool IsEnabled() const { return enable_; }
+    void Reset();
+
+    // Sample the words between the event start and end markers (exclusive) if the event is due
+    void SampleEvent(const uint32_t *words, size_t num_words, size_t event_number);
+    // Publish a snapshot now if the period has passed, or always with `force`
+    void Update(bool force);
+
+    Snapshot GetSnapshot() const;
+    // The table as written to `snapshot_file`, also sent with the json metrics
+    static nlohmann::json SnapshotJson(const Snapshot &snapshot);
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+    static constexpr size_t kMaxChannels = 64;
+    static constexpr size_t kMaxModules = 32;
+
+private:
+
+    struct Accumulator {
+        uint64_t n = 0;
+        double mean = 0.;
+        double m2 = 0.;
+    };
+
+    void SampleFem(uint32_t module, const uint16_t *halves, size_t num_halves);
+    void SampleChannel(Accumulator &acc, const uint16_t *samples, size_t num_samples);
+    void TakeSnapshot();
+    bool WriteSnapshot(const Snapshot &snapshot) const;
+
+    bool enable_ = false;
+    size_t prescale_ = 100;
+    size_t window_samples_ = 32;
+    uint64_t snapshot_period_ns_ = 60000000000ULL;
+    uint32_t first_module_ = 0;
+    uint32_t last_module_ = kMaxModules - 1;
+    std::string snapshot_file_;
+
+    std::array<std::array<Accumulator, kMaxChannels>, kMaxModules> accumulators_{};
+    std::vector<uint16_t> halves_;
+    uint64_t period_start_ns_ = 0;
+    uint64_t period_events_ = 0;
+
+    // The first snapshot of the run is the reference for the drift
+    mutable std::mutex snapshot_mutex_;
+    Snapshot snapshot_;
+    Snapshot reference_;
+
+    std::atomic<size_t> num_sampled_events_ = 0;
+    std::atomic<size_t> num_snapshots_ = 0;
+    std::atomic<size_t> num_write_errors_ = 0;
+};
+
+} // data_handler
+
+#endif //PEDESTAL_MONITOR_H
@@ -0,0 +1,202 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "primitive_finder.h"
+#include "fem_data_validator.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace data_handler {
+
+    namespace {
+        constexpr uint32_t kEventStartWord = 0xFFFFFFFF;
+        constexpr uint32_t kEventEndWord = 0xE0000000;
+        constexpr uint16_t kChannelStart = 0x4000;
+        constexpr uint16_t kChannelEnd = 0x5000;
+        constexpr uint16_t kMarkerMask = 0xF000;
+    }
+
+    void PrimitiveFinder::Configure(const bool enable, const uint32_t threshold, const size_t min_tot,
+                                    const size_t baseline_samples, const size_t waveform_prescale,
+                                    const uint32_t first_module, const uint32_t last_module,
+                                    const size_t max_queued_blocks) {
+        Stop();
+        enable_ = enable;
+        threshold_ = threshold;
+        min_tot_ = std::max(min_tot, size_t{1});
+        baseline_samples_ = std::max(baseline_samples, size_t{1});
+        waveform_prescale_ = waveform_prescale;
+        first_module_ = first_module;
+        last_module_ = last_module;
+        max_queued_blocks_ = max_queued_blocks;
+    }
+
+    bool PrimitiveFinder::Start() {
+        Stop();
+        if (!enable_) return false;
+        writer_.ResetCounters();
+        block_.clear();
+        num_waveform_candidates_ = 0;
+        num_events_.store(0);
+        num_primitives_.store(0);
+        num_waveform_events_dropped_.store(0);
+        num_record_words_.store(0);
+        return writer_.Start(max_queued_blocks_);
+    }
+
+    void PrimitiveFinder::Stop() {
+        if (writer_.IsRunning()) writer_.Stop();
+    }
+
+    void PrimitiveFinder::OpenFile(const std::string &file_name, const uint64_t run_number,
+                                   const uint64_t subrun_number, const uint64_t config_hash) {
+        // What was found so far belongs to the previous file
+        WriteBlock();
+        writer_.Open(file_name, run_number, subrun_number, config_hash);
+    }
+
+    uint16_t PrimitiveFinder::Baseline(const uint16_t *samples, const size_t num_samples) {
+        const size_t n = std::min(num_samples, baseline_samples_);
+        baseline_scratch_.assign(samples, samples + n);
+        std::nth_element(baseline_scratch_.begin(), baseline_scratch_.begin() + n / 2, baseline_scratch_.end());
+        return baseline_scratch_[n / 2];
+    }
+
+    void PrimitiveFinder::FindPrimitives(const uint32_t module, const uint32_t channel, const uint16_t *samples,
+                                         const size_t num_samples, std::vector<Primitive> &primitives) {
+        if (num_samples == 0) return;
+        const int baseline = Baseline(samples, num_samples);
+        const int level = baseline + static_cast<int>(threshold_);
+        bool in_pulse = false;
+        Primitive primitive{module, channel, 0, 0, 0, 0};
+
+        auto step = [&](const size_t s) {
+            const int value = samples[s];
+            if (value > level) {
+                if (!in_pulse) {
+                    in_pulse = true;
+                    primitive.start = static_cast<uint32_t>(s);
+                    primitive.tot = 0;
+                    primitive.peak = 0;
+                    primitive.integral = 0;
+                }
+                primitive.tot++;
+                primitive.peak = std::max(primitive.peak, static_cast<uint32_t>(value - baseline));
+                primitive.integral += static_cast<uint32_t>(value - baseline);
+            } else if (in_pulse) {
+                in_pulse = false;
+                if (primitive.tot >= min_tot_) primitives.push_back(primitive);
+            }
+        };
+
+        size_t s = 0;
+#ifdef __SSE2__
+        // The samples are 12b so a signed 16b compare is safe, only blocks with a sample over the
+        // threshold (or a pulse still going) are looked at sample by sample
+        const __m128i level_vec = _mm_set1_epi16(static_cast<int16_t>(std::min(level, 0x7FFF)));
+        for (; s + 8 <= num_samples; s += 8) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + s));
+            if (!in_pulse && _mm_movemask_epi8(_mm_cmpgt_epi16(block, level_vec)) == 0) continue;
+            for (size_t k = s; k < s + 8; k++) step(k);
+        }
+#endif
+        for (; s < num_samples; s++) step(s);
+        if (in_pulse && primitive.tot >= min_tot_) primitives.push_back(primitive);
+    }
+
+    void PrimitiveFinder::FindFem(const uint32_t module, const uint16_t *halves, const size_t num_halves) {
+        size_t i = 0;
+        while (i < num_halves) {
+            if ((halves[i] & kMarkerMask) != kChannelStart) {
+                i++;
+                continue;
+            }
+            const uint32_t channel = halves[i] & 0x3F;
+            const size_t start = i + 1;
+            size_t end = start;
+            while (end < num_halves && (halves[end] & kMarkerMask) == 0) end++;
+            i = end;
+            // Only plain 12b samples, suppressed or Huffman encoded channels are skipped
+            if (end == num_halves || halves[end] != (kChannelEnd | channel)) continue;
+            FindPrimitives(module, channel, halves + start, end - start, primitives_);
+        }
+    }
+
+    void PrimitiveFinder::FindEvent(const uint32_t *words, const size_t num_words, const uint64_t event_number) {
+        if (!enable_) return;
+        primitives_.clear();
+        FemDataValidator::FemHeader first_header{};
+        bool has_header = false;
+
+        size_t header_idx = FemDataValidator::FindNextHeader(words, 0, num_words);
+        while (header_idx + FemDataValidator::kHeaderWords <= num_words) {
+            const FemDataValidator::FemHeader header = FemDataValidator::DecodeHeader(words + header_idx);
+            const size_t payload_begin = header_idx + FemDataValidator::kHeaderWords;
+            const size_t next_header = FemDataValidator::FindNextHeader(words, payload_begin, num_words);
+            const size_t payload_words = next_header - payload_begin;
+            if (!has_header) {
+                first_header = header;
+                has_header = true;
+            }
+            if (header.module >= first_module_ && header.module <= last_module_ &&
+                ((header.word_count + 1) / 2) == payload_words) {
+                halves_.resize(2 * payload_words);
+                std::memcpy(halves_.data(), words + payload_begin, payload_words * sizeof(uint32_t));
+                FindFem(header.module, halves_.data(), header.word_count);
+            }
+            header_idx = next_header;
+        }
+
+        if (block_.empty()) block_first_event_ = event_number;
+        block_last_event_ = event_number;
+        const size_t record_begin = block_.size();
+        block_.push_back(kEventStartWord);
+        block_.push_back(kRecordMarker | static_cast<uint32_t>(primitives_.size() & 0xFFFFFF));
+        block_.push_back(static_cast<uint32_t>(event_number));
+        block_.push_back(first_header.event_number);
+        block_.push_back(first_header.frame_number);
+        for (const auto &primitive : primitives_) {
+            block_.push_back((primitive.module << 24) | (primitive.channel << 16) | (primitive.start & 0xFFFF));
+            block_.push_back((std::min(primitive.tot, 0xFFFFu) << 16) | std::min(primitive.peak, 0xFFFFu));
+            block_.push_back(primitive.integral);
+        }
+        block_.push_back(kEventEndWord);
+
+        num_events_++;
+        num_primitives_ += primitives_.size();
+        num_record_words_ += block_.size() - record_begin;
+        if (block_.size() >= kMaxBlockWords) WriteBlock();
+    }
+
+    bool PrimitiveFinder::KeepWaveforms() {
+        if (!enable_ || waveform_prescale_ == 0) return true;
+        if ((num_waveform_candidates_++ % waveform_prescale_) == 0) return true;
+        num_waveform_events_dropped_++;
+        return false;
+    }
+
+    void PrimitiveFinder::WriteBlock() {
+        if (block_.empty()) return;
+        if (writer_.IsRunning()) writer_.Write(block_.data(), block_.size(), block_first_event_, block_last_event_, true);
+        block_.clear();
+    }
+
+    void PrimitiveFinder::CloseFile(const bool sync) {
+        WriteBlock();
+        if (writer_.IsRunning()) writer_.Close(sync);
+    }
+
+    void PrimitiveFinder::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["tp_events"] = num_events_.load();
+        metrics["tp_primitives"] = num_primitives_.load();
+        metrics["tp_waveforms_dropped"] = num_waveform_events_dropped_.load();
+        metrics["tp_stream_mb"] = num_record_words_.load() * sizeof(uint32_t) / 1000000;
+        metrics["tp_errors"] = writer_.NumErrors();
+    }
+
+} // data_handler
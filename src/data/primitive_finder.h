@@ -0,0 +1,121 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef PRIMITIVE_FINDER_H
+#define PRIMITIVE_FINDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "async_file_writer.h"
+
+namespace data_handler {
+
+/*
+ * Online trigger primitive finder for the charge waveforms.
+ *
+ * For every charge channel (0x4000|ch samples... 0x5000|ch) the baseline is the median of the
+ * first `baseline_samples` samples. The waveform is scanned 8 samples at a time with SSE2 and
+ * blocks with nothing above baseline + `threshold` are skipped; a run of at least `min_tot`
+ * samples above it is a primitive with its start time, time over threshold, peak and
+ * integral (both above the baseline). Only positive going pulses are found.
+ *
+ * The primitives go to their own compact stream, one record per event
+ *   0xFFFFFFFF  0xA5000000 | number of primitives  event number  FEM event number  FEM frame
+ *   [module << 24 | channel << 16 | start sample,  tot << 16 | peak,  integral]...  0xE0000000
+ * so with `waveform_prescale` set only every Nth event needs its full waveforms written and the
+ * rest are kept as primitives. The stream is written in blocks by its own `AsyncFileWriter`
+ * thread, never dropped, one file per data file.
+ *
+ * Called from the write thread only, the counters can be read from any thread.
+ */
+class PrimitiveFinder {
+public:
+
+    static constexpr uint32_t kRecordMarker = 0xA5000000;
+    static constexpr size_t kRecordHeaderWords = 5;
+    static constexpr size_t kPrimitiveWords = 3;
+
+    struct Primitive {
+        uint32_t module;
+        uint32_t channel;
+        uint32_t start;
+        uint32_t tot;
+        uint32_t peak;
+        uint32_t integral;
+    };
+
+    PrimitiveFinder() = default;
+    ~PrimitiveFinder() = default;
+
+    // Only while stopped, a `waveform_prescale` of 0 keeps the waveforms of every event
+    void Configure(bool enable, uint32_t threshold, size_t min_tot, size_t baseline_samples,
+                   size_t waveform_prescale, uint32_t first_module, uint32_t last_module, size_t max_queued_blocks);
+    bool IsEnabled() const { return enable_; }
+    void SetContainer(bool use_container) { writer_.SetContainer(use_container); }
+    void SetManifest(bool write_manifest) { writer_.SetManifest(write_manifest); }
+    void SetFlusher(FileFlusher *flusher) { writer_.SetFlusher(flusher); }
+
+    bool Start();
+    void Stop();
+    bool IsRunning() const { return writer_.IsRunning(); }
+
+    void OpenFile(const std::string &file_name, uint64_t run_number, uint64_t subrun_number, uint64_t config_hash);
+    // Find the primitives in the words between the event start and end markers (exclusive)
+    // and add the event record to the stream
+    void FindEvent(const uint32_t *words, size_t num_words, uint64_t event_number);
+    // False if only the primitives of the event are kept, every `waveform_prescale`th event
+    // asked about keeps its waveforms
+    bool KeepWaveforms();
+    // Queue the records added since the last block
+    void WriteBlock();
+    void CloseFile(bool sync);
+
+    // Primitives of one channel's samples, appended to `primitives`
+    void FindPrimitives(uint32_t module, uint32_t channel, const uint16_t *samples, size_t num_samples,
+                        std::vector<Primitive> &primitives);
+
+    uint64_t NumErrors() const { return writer_.NumErrors(); }
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+private:
+
+    void FindFem(uint32_t module, const uint16_t *halves, size_t num_halves);
+    uint16_t Baseline(const uint16_t *samples, size_t num_samples);
+
+    // Flush a block once this many words are waiting, so the stream keeps moving while
+    // most events are kept as primitives only
+    static constexpr size_t kMaxBlockWords = 1 << 18;
+
+    bool enable_ = false;
+    uint32_t threshold_ = 20;
+    size_t min_tot_ = 2;
+    size_t baseline_samples_ = 16;
+    size_t waveform_prescale_ = 0;
+    uint32_t first_module_ = 0;
+    uint32_t last_module_ = 31;
+    size_t max_queued_blocks_ = 16;
+    AsyncFileWriter writer_{};
+
+    std::vector<uint32_t> block_;
+    uint64_t block_first_event_ = 0;
+    uint64_t block_last_event_ = 0;
+    std::vector<Primitive> primitives_;
+    std::vector<uint16_t> halves_;
+    std::vector<uint16_t> baseline_scratch_;
+    uint64_t num_waveform_candidates_ = 0;
+
+    std::atomic<size_t> num_events_ = 0;
+    std::atomic<size_t> num_primitives_ = 0;
+    std::atomic<size_t> num_waveform_events_dropped_ = 0;
+    std::atomic<uint64_t> num_record_words_ = 0;
+};
+
+} // data_handler
+
+#endif //PRIMITIVE_FINDER_H
@@ -0,0 +1,200 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "sample_packing.h"
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <tmmintrin.h>
+#endif
+
+namespace data_handler {
+
+    namespace {
+        constexpr size_t kGroupWords = 4;
+        constexpr size_t kGroupBytes = kGroupWords * sizeof(uint32_t);
+        constexpr size_t kPackedGroupBytes = kGroupWords * 3;
+        constexpr size_t kHeaderWords = sizeof(PackedFrameHeader) / sizeof(uint32_t);
+        // The SSE stores write a full 16B for a 12B packed group
+        constexpr size_t kStoreSlackBytes = kGroupBytes - kPackedGroupBytes;
+
+        size_t BitmapWords(const size_t num_groups) { return (num_groups + 31) / 32; }
+
+        bool IsSampleGroup(const uint32_t *words) {
+            uint32_t flags = 0;
+            for (size_t i = 0; i < kGroupWords; i++) flags |= words[i];
+            return (flags & 0xF000F000) == 0;
+        }
+
+        void PackGroupScalar(const uint32_t *words, uint8_t *out) {
+            for (size_t i = 0; i < kGroupWords; i++) {
+                const uint32_t packed = (words[i] & 0xFFF) | ((words[i] >> 4) & 0xFFF000);
+                out[3 * i] = packed & 0xFF;
+                out[3 * i + 1] = (packed >> 8) & 0xFF;
+                out[3 * i + 2] = (packed >> 16) & 0xFF;
+            }
+        }
+
+        void UnpackGroupScalar(const uint8_t *in, uint32_t *words) {
+            for (size_t i = 0; i < kGroupWords; i++) {
+                const uint32_t packed = in[3 * i] | (in[3 * i + 1] << 8) | (in[3 * i + 2] << 16);
+                words[i] = (packed & 0xFFF) | ((packed << 4) & 0x0FFF0000);
+            }
+        }
+
+        // Returns the number of bytes written to `out`, groups are packed while `bitmap` is built
+        size_t PackGroupsScalar(const uint32_t *words, const size_t num_groups, uint32_t *bitmap, uint8_t *out) {
+            uint8_t *out_begin = out;
+            for (size_t g = 0; g < num_groups; g++, words += kGroupWords) {
+                if (IsSampleGroup(words)) {
+                    bitmap[g / 32] |= 1u << (g % 32);
+                    PackGroupScalar(words, out);
+                    out += kPackedGroupBytes;
+                } else {
+                    std::memcpy(out, words, kGroupBytes);
+                    out += kGroupBytes;
+                }
+            }
+            return static_cast<size_t>(out - out_begin);
+        }
+
+        size_t UnpackGroupsScalar(const uint8_t *in, const size_t num_groups, const uint32_t *bitmap, uint32_t *words) {
+            const uint8_t *in_begin = in;
+            for (size_t g = 0; g < num_groups; g++, words += kGroupWords) {
+                if (bitmap[g / 32] & (1u << (g % 32))) {
+                    UnpackGroupScalar(in, words);
+                    in += kPackedGroupBytes;
+                } else {
+                    std::memcpy(words, in, kGroupBytes);
+                    in += kGroupBytes;
+                }
+            }
+            return static_cast<size_t>(in - in_begin);
+        }
+
+#if defined(__x86_64__)
+        // Built for SSSE3 (pshufb) regardless of the compile flags, only called if the CPU has it
+        __attribute__((target("ssse3")))
+        size_t PackGroupsSsse3(const uint32_t *words, const size_t num_groups, uint32_t *bitmap, uint8_t *out) {
+            uint8_t *out_begin = out;
+            const __m128i flag_mask = _mm_set1_epi32(static_cast<int>(0xF000F000));
+            const __m128i low_mask = _mm_set1_epi32(0x00000FFF);
+            const __m128i high_mask = _mm_set1_epi32(0x00FFF000);
+            // Take the low 3 bytes of each 32b lane
+            const __m128i compact = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            for (size_t g = 0; g < num_groups; g++, words += kGroupWords) {
+                const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words));
+                const __m128i flags = _mm_and_si128(group, flag_mask);
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(flags, _mm_setzero_si128())) == 0xFFFF) {
+                    bitmap[g / 32] |= 1u << (g % 32);
+                    const __m128i packed = _mm_or_si128(_mm_and_si128(group, low_mask),
+                                                        _mm_and_si128(_mm_srli_epi32(group, 4), high_mask));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_shuffle_epi8(packed, compact));
+                    out += kPackedGroupBytes;
+                } else {
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), group);
+                    out += kGroupBytes;
+                }
+            }
+            return static_cast<size_t>(out - out_begin);
+        }
+
+        __attribute__((target("ssse3")))
+        size_t UnpackGroupsSsse3(const uint8_t *in, const size_t num_groups, const uint32_t *bitmap, uint32_t *words) {
+            const uint8_t *in_begin = in;
+            const __m128i low_mask = _mm_set1_epi32(0x00000FFF);
+            const __m128i high_mask = _mm_set1_epi32(0x0FFF0000);
+            // Spread 3 bytes into each 32b lane, the top byte zeroed
+            const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            for (size_t g = 0; g < num_groups; g++, words += kGroupWords) {
+                if (bitmap[g / 32] & (1u << (g % 32))) {
+                    // Reading 16B for 12B is safe, the frame always has data or slack after a group
+                    const __m128i packed = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in)), expand);
+                    const __m128i group = _mm_or_si128(_mm_and_si128(packed, low_mask),
+                                                       _mm_and_si128(_mm_slli_epi32(packed, 4), high_mask));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(words), group);
+                    in += kPackedGroupBytes;
+                } else {
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(words), _mm_loadu_si128(reinterpret_cast<const __m128i *>(in)));
+                    in += kGroupBytes;
+                }
+            }
+            return static_cast<size_t>(in - in_begin);
+        }
+
+        const bool kHasSsse3 = __builtin_cpu_supports("ssse3");
+#endif
+    }
+
+    void PackSamples(const uint32_t *words, const size_t num_words, std::vector<uint32_t> &frame) {
+        const size_t num_groups = num_words / kGroupWords;
+        const size_t tail_words = num_words % kGroupWords;
+        const size_t bitmap_words = BitmapWords(num_groups);
+        // Worst case nothing packs, plus slack for the last 16B store
+        const size_t max_bytes = num_words * sizeof(uint32_t) + kStoreSlackBytes;
+        frame.assign(kHeaderWords + bitmap_words + (max_bytes + 3) / 4, 0);
+
+        uint32_t *bitmap = frame.data() + kHeaderWords;
+        auto *out = reinterpret_cast<uint8_t *>(bitmap + bitmap_words);
+        size_t num_bytes;
+#if defined(__x86_64__)
+        if (kHasSsse3) num_bytes = PackGroupsSsse3(words, num_groups, bitmap, out);
+        else num_bytes = PackGroupsScalar(words, num_groups, bitmap, out);
+#else
+        num_bytes = PackGroupsScalar(words, num_groups, bitmap, out);
+#endif
+        std::memcpy(out + num_bytes, words + num_groups * kGroupWords, tail_words * sizeof(uint32_t));
+        num_bytes += tail_words * sizeof(uint32_t);
+
+        // Clear whatever the last store left past the end, then trim to whole words. Keep the
+        // store slack so the SSE unpack can read 16B at the last group.
+        const size_t used_bytes = num_bytes + kStoreSlackBytes;
+        std::memset(out + num_bytes, 0, (frame.size() - kHeaderWords - bitmap_words) * sizeof(uint32_t) - num_bytes);
+        frame.resize(kHeaderWords + bitmap_words + (used_bytes + 3) / 4);
+
+        PackedFrameHeader header{};
+        header.magic = PackedFrameHeader::kMagic;
+        header.num_words = static_cast<uint32_t>(num_words);
+        header.num_bytes = static_cast<uint32_t>(num_bytes);
+        std::memcpy(frame.data(), &header, sizeof(header));
+    }
+
+    bool IsPackedFrame(const uint32_t *words, const size_t num_words) {
+        return num_words >= kHeaderWords && words[0] == PackedFrameHeader::kMagic;
+    }
+
+    bool UnpackSamples(const uint32_t *frame, const size_t frame_words, std::vector<uint32_t> &words) {
+        if (!IsPackedFrame(frame, frame_words)) return false;
+        PackedFrameHeader header{};
+        std::memcpy(&header, frame, sizeof(header));
+
+        const size_t num_groups = header.num_words / kGroupWords;
+        const size_t tail_words = header.num_words % kGroupWords;
+        const size_t bitmap_words = BitmapWords(num_groups);
+        if (kHeaderWords + bitmap_words > frame_words) return false;
+
+        // Check the packed size against the bitmap before touching the data
+        const uint32_t *bitmap = frame + kHeaderWords;
+        size_t packed_groups = 0;
+        for (size_t i = 0; i < bitmap_words; i++) packed_groups += __builtin_popcount(bitmap[i]);
+        const size_t expected_bytes = packed_groups * kPackedGroupBytes + (num_groups - packed_groups) * kGroupBytes +
+                                      tail_words * sizeof(uint32_t);
+        const size_t available_bytes = (frame_words - kHeaderWords - bitmap_words) * sizeof(uint32_t);
+        if (packed_groups > num_groups || expected_bytes != header.num_bytes ||
+            expected_bytes + kStoreSlackBytes > available_bytes) return false;
+
+        words.resize(header.num_words);
+        const auto *in = reinterpret_cast<const uint8_t *>(bitmap + bitmap_words);
+        size_t num_bytes;
+#if defined(__x86_64__)
+        if (kHasSsse3) num_bytes = UnpackGroupsSsse3(in, num_groups, bitmap, words.data());
+        else num_bytes = UnpackGroupsScalar(in, num_groups, bitmap, words.data());
+#else
+        num_bytes = UnpackGroupsScalar(in, num_groups, bitmap, words.data());
+#endif
+        std::memcpy(words.data() + num_groups * kGroupWords, in + num_bytes, tail_words * sizeof(uint32_t));
+        return true;
+    }
+
+} // data_handler
@@ -0,0 +1,84 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "stage_timer.h"
+#include <algorithm>
+
+namespace data_handler {
+
+    size_t StageHistogram::BinIndex(const uint64_t value) {
+        // Values below 8 get their own bin, above that the top 3 bits after the
+        // leading one select one of the 8 linear sub-bins of that power of two.
+        if (value < kSubBins) return static_cast<size_t>(value);
+        const size_t msb = 63 - static_cast<size_t>(__builtin_clzll(value));
+        const size_t sub_bin = static_cast<size_t>(value >> (msb - 3)) & (kSubBins - 1);
+        return (msb - 2) * kSubBins + sub_bin;
+    }
+
+    uint64_t StageHistogram::BinUpperEdge(const size_t index) {
+        if (index < kSubBins) return index;
+        const size_t msb = index / kSubBins + 2;
+        const uint64_t sub_bin = index % kSubBins;
+        const uint64_t lower_edge = (kSubBins + sub_bin) << (msb - 3);
+        return lower_edge + (uint64_t{1} << (msb - 3)) - 1;
+    }
+
+    void StageHistogram::Record(const uint64_t value_ns) {
+        bins_[BinIndex(value_ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        // Single writer so no need for a CAS loop
+        if (value_ns > max_ns_.load(std::memory_order_relaxed)) max_ns_.store(value_ns, std::memory_order_relaxed);
+    }
+
+    void StageHistogram::Reset() {
+        for (auto &bin : bins_) bin.store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        max_ns_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t StageHistogram::Quantile(const double q) const {
+        const uint64_t count = Count();
+        if (count == 0) return 0;
+        // Rank of the requested quantile, at least 1 so q=0 gives the minimum
+        auto rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+        if (rank == 0) rank = 1;
+
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < kNumBins; i++) {
+            cumulative += bins_[i].load(std::memory_order_relaxed);
+            // The upper edge can overshoot the real maximum for the top bin
+            if (cumulative >= rank) return std::min(BinUpperEdge(i), Max());
+        }
+        // The counters are read while being updated so the sum can lag the count
+        return Max();
+    }
+
+    void PipelineTimers::Reset() {
+        for (auto &stage : stages_) stage.Reset();
+    }
+
+    const char *PipelineTimers::StageName(const Stage stage) {
+        switch (stage) {
+            case Stage::kDmaArm: return "stage_dma_arm";
+            case Stage::kDmaWait: return "stage_dma_wait";
+            case Stage::kCpuSync: return "stage_cpu_sync";
+            case Stage::kMemcpy: return "stage_memcpy";
+            case Stage::kEnqueueWait: return "stage_enqueue_wait";
+            case Stage::kEventScan: return "stage_event_scan";
+            case Stage::kWrite: return "stage_write";
+            default: return "stage_unknown";
+        }
+    }
+
+    void PipelineTimers::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        for (size_t i = 0; i < stages_.size(); i++) {
+            const StageHistogram &histogram = stages_[i];
+            const std::string name = StageName(static_cast<Stage>(i));
+            metrics[name + "_p50_us"] = histogram.Quantile(0.50) / 1000;
+            metrics[name + "_p99_us"] = histogram.Quantile(0.99) / 1000;
+            metrics[name + "_max_us"] = histogram.Max() / 1000;
+        }
+    }
+
+} // data_handler
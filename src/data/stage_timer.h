@@ -0,0 +1,98 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace data_handler {
+
+/*
+ * Lock-free latency histogram for one stage of the readout pipeline.
+ *
+ * Values are in ns and binned log-linear, 8 bins per power of two, so any quantile is known
+ * to within ~12% from 1ns up to the full 64b range with a fixed 4kB of counters. Each
+ * histogram has a single writer thread, readers (the status thread) only load the counters
+ * so recording is a couple of relaxed atomic adds and never blocks.
+ */
+class StageHistogram {
+public:
+
+    StageHistogram() = default;
+    ~StageHistogram() = default;
+
+    void Record(uint64_t value_ns);
+    void Reset();
+
+    // Approximate quantile, q in [0,1]
+    uint64_t Quantile(double q) const;
+    uint64_t Max() const { return max_ns_.load(std::memory_order_relaxed); }
+    uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+
+private:
+
+    static constexpr size_t kSubBins = 8;
+    static constexpr size_t kNumBins = (64 - 2) * kSubBins;
+
+    static size_t BinIndex(uint64_t value);
+    static uint64_t BinUpperEdge(size_t index);
+
+    std::array<std::atomic<uint64_t>, kNumBins> bins_{};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> max_ns_ = 0;
+};
+
+/*
+ * Timing of each stage of the data path, from arming the DMA to the write to disk.
+ * The read thread owns the DMA stages and the enqueue, the write thread the event scan and
+ * the file write. Published as <stage>_p50_us, <stage>_p99_us and <stage>_max_us.
+ */
+class PipelineTimers {
+public:
+
+    enum class Stage : size_t {
+        kDmaArm,      // receiver and DMA register setup until the DMA is started
+        kDmaWait,     // waiting for the DMA to complete
+        kCpuSync,     // DMA buffer cache syncs
+        kMemcpy,      // copy out of the DMA buffer
+        kEnqueueWait, // push into the read/write queue
+        kEventScan,   // splitting a buffer into events, excluding the writes
+        kWrite,       // write() of an event chunk
+        kNumStages
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    static uint64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    void Record(Stage stage, uint64_t duration_ns) { Histogram(stage).Record(duration_ns); }
+    // Record the time since `start_ns` and return the current time so stages can be chained
+    uint64_t RecordSince(Stage stage, uint64_t start_ns) {
+        const uint64_t now = NowNs();
+        Record(stage, now - start_ns);
+        return now;
+    }
+    void Reset();
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+private:
+
+    StageHistogram &Histogram(Stage stage) { return stages_[static_cast<size_t>(stage)]; }
+    static const char *StageName(Stage stage);
+
+    std::array<StageHistogram, static_cast<size_t>(Stage::kNumStages)> stages_{};
+};
+
+} // data_handler
+
+#endif //STAGE_TIMER_H
@@ -0,0 +1,140 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "storage_manager.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <set>
+#include <sys/statvfs.h>
+
+namespace data_handler {
+
+    namespace {
+        // Weight of the newest rate sample in the running average
+        constexpr double kRateWeight = 0.3;
+        // Reported when nothing is being written
+        constexpr double kMaxHours = 1e6;
+
+        uint64_t SteadyNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        double HoursLeft(const uint64_t free_bytes, const double rate) {
+            if (rate <= 0.) return kMaxHours;
+            return std::min(static_cast<double>(free_bytes) / rate / 3600., kMaxHours);
+        }
+    }
+
+    void StorageManager::Configure(const bool enable, const double min_hours, const double recover_hours,
+                                   const size_t check_period_s, const Policy &policy) {
+        enable_ = enable;
+        min_hours_ = min_hours;
+        // Leave a gap so the mode doesn't flap around the threshold
+        recover_hours_ = std::max(recover_hours, min_hours);
+        check_period_ns_ = std::max(check_period_s, size_t{1}) * 1000000000ULL;
+        policy_ = policy;
+        policy_.prescale = std::max(policy_.prescale, size_t{1});
+    }
+
+    std::shared_ptr<std::atomic<uint64_t>> StorageShare::Counter(const unsigned long file_system) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &counter = counters_[file_system];
+        if (!counter) counter = std::make_shared<std::atomic<uint64_t>>(0);
+        return counter;
+    }
+
+    void StorageManager::AddVolume(const std::vector<std::string> &directories) {
+        if (!directories.empty()) volumes_.push_back(directories);
+    }
+
+    void StorageManager::Reset() {
+        is_reduced_ = false;
+        last_check_ns_ = 0;
+        last_bytes_ = 0;
+        write_rate_ = 0.;
+        normal_write_rate_ = 0.;
+        num_reduced_candidates_ = 0;
+        own_bytes_ = 0;
+        shared_bytes_.reset();
+        struct statvfs stats{};
+        if (share_ && !volumes_.empty() && statvfs(volumes_.front().front().c_str(), &stats) == 0) {
+            shared_bytes_ = share_->Counter(stats.f_fsid);
+        }
+        hours_to_full_.store(kMaxHours);
+        write_rate_kbps_.store(0);
+        num_mode_switches_.store(0);
+        num_prescaled_.store(0);
+        reduced_mode_.store(false);
+    }
+
+    uint64_t StorageManager::FreeBytes(const std::vector<std::string> &directories) {
+        // Directories on the same file system are only counted once
+        std::set<unsigned long> file_systems;
+        uint64_t free_bytes = 0;
+        for (const auto &directory : directories) {
+            struct statvfs stats{};
+            if (statvfs(directory.c_str(), &stats) != 0) continue;
+            if (!file_systems.insert(stats.f_fsid).second) continue;
+            free_bytes += static_cast<uint64_t>(stats.f_bavail) * stats.f_frsize;
+        }
+        return free_bytes;
+    }
+
+    bool StorageManager::Update(uint64_t bytes_written) {
+        // Our bytes count for the other pairs even if we don't manage the storage ourselves
+        if (shared_bytes_) {
+            if (bytes_written > own_bytes_) shared_bytes_->fetch_add(bytes_written - own_bytes_, std::memory_order_relaxed);
+            own_bytes_ = bytes_written;
+            bytes_written = shared_bytes_->load(std::memory_order_relaxed);
+        }
+        if (!enable_ || volumes_.empty()) return false;
+        const uint64_t now = SteadyNs();
+        if (last_check_ns_ == 0 || bytes_written < last_bytes_) {
+            last_check_ns_ = now;
+            last_bytes_ = bytes_written;
+            return false;
+        }
+        if (now - last_check_ns_ < check_period_ns_) return false;
+
+        const double rate = static_cast<double>(bytes_written - last_bytes_) /
+                            (static_cast<double>(now - last_check_ns_) * 1e-9);
+        write_rate_ = write_rate_ == 0. ? rate : (kRateWeight * rate + (1. - kRateWeight) * write_rate_);
+        last_check_ns_ = now;
+        last_bytes_ = bytes_written;
+
+        uint64_t min_free = std::numeric_limits<uint64_t>::max();
+        for (const auto &volume : volumes_) min_free = std::min(min_free, FreeBytes(volume));
+        const double hours = HoursLeft(min_free, write_rate_);
+        min_free_bytes_.store(min_free);
+        hours_to_full_.store(hours);
+        write_rate_kbps_.store(static_cast<uint64_t>(write_rate_ / 1000.));
+
+        bool changed = false;
+        if (!is_reduced_) {
+            normal_write_rate_ = write_rate_;
+            changed = hours < min_hours_;
+        } else {
+            // Judge the recovery on the full data rate, not the reduced one
+            changed = HoursLeft(min_free, normal_write_rate_) > recover_hours_;
+        }
+        if (changed) {
+            is_reduced_ = !is_reduced_;
+            reduced_mode_.store(is_reduced_);
+            num_mode_switches_++;
+        }
+        return changed;
+    }
+
+    void StorageManager::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["storage_free_mb"] = min_free_bytes_.load() / 1000000;
+        metrics["storage_write_rate_kbps"] = write_rate_kbps_.load();
+        metrics["storage_hours_to_full"] = static_cast<size_t>(hours_to_full_.load());
+        metrics["storage_reduced_mode"] = reduced_mode_.load() ? 1 : 0;
+        metrics["storage_mode_switches"] = num_mode_switches_.load();
+        metrics["storage_prescaled_events"] = num_prescaled_.load();
+    }
+
+} // data_handler
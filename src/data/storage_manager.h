@@ -0,0 +1,120 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef STORAGE_MANAGER_H
+#define STORAGE_MANAGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace data_handler {
+
+/*
+ * The bytes written by the pipelines of all the card pairs, by the file system of their main
+ * data volume. Pairs writing to the same disk then predict its time to full from their combined
+ * write rate, not each from its own share of it.
+ */
+class StorageShare {
+public:
+
+    // The counter of a file system, created on first use
+    std::shared_ptr<std::atomic<uint64_t>> Counter(unsigned long file_system);
+
+private:
+
+    std::mutex mutex_;
+    std::map<unsigned long, std::shared_ptr<std::atomic<uint64_t>>> counters_;
+};
+
+/*
+ * Keeps the data volumes from filling up during a long flight.
+ *
+ * Every `check_period_s` the write rate (averaged over a few periods) is compared against the
+ * free space left on the data volumes to predict the time until they are full. Each volume is
+ * a set of directories written at the same rate, e.g. the striped output directories and the
+ * mirror. Once the time to full drops below `min_hours` the writer switches to a reduced data
+ * mode, as set by the policy: only every `prescale` event is kept, the compression is turned
+ * on and/or only the light data is kept. It switches back once the prediction at the normal
+ * write rate is above `recover_hours` again, e.g. after files have been removed.
+ *
+ * Owned by the write thread, the metrics can be read from any thread.
+ */
+class StorageManager {
+public:
+
+    struct Policy {
+        size_t prescale = 10;    // keep every Nth event, 1 keeps all of them
+        bool compress = true;
+        bool light_only = false; // drop the charge FEM data
+    };
+
+    StorageManager() = default;
+    ~StorageManager() = default;
+
+    void Configure(bool enable, double min_hours, double recover_hours, size_t check_period_s, const Policy &policy);
+    // Directories which share the write rate, their free space is summed. Only while stopped.
+    void AddVolume(const std::vector<std::string> &directories);
+    void ClearVolumes() { volumes_.clear(); }
+    // Share the write rate with the other card pairs on the same disk. Only while stopped.
+    void SetShare(std::shared_ptr<StorageShare> share) { share_ = std::move(share); }
+    bool IsEnabled() const { return enable_; }
+    const Policy &ReducedPolicy() const { return policy_; }
+    void Reset();
+
+    // Called by the write thread with the total bytes written so far in the run, only does
+    // any work once per check period. Returns true if the data mode changed. With a share the
+    // rate is that of all the pairs writing to the main volume's file system.
+    bool Update(uint64_t bytes_written);
+
+    bool IsReduced() const { return is_reduced_; }
+    // Every `prescale`th event asked about while reduced is kept, counted on its own so it
+    // combines with other prescales ahead of it
+    bool KeepEvent() { return !is_reduced_ || (num_reduced_candidates_++ % policy_.prescale) == 0; }
+    bool CompressReduced() const { return is_reduced_ && policy_.compress; }
+    bool LightOnlyReduced() const { return is_reduced_ && policy_.light_only; }
+    void CountPrescaled() { num_prescaled_.fetch_add(1, std::memory_order_relaxed); }
+
+    // Hours until the first volume is full at the current write rate
+    double HoursToFull() const { return hours_to_full_.load(std::memory_order_relaxed); }
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+private:
+
+    static uint64_t FreeBytes(const std::vector<std::string> &directories);
+
+    bool enable_ = false;
+    double min_hours_ = 6.;
+    double recover_hours_ = 12.;
+    uint64_t check_period_ns_ = 10000000000;
+    Policy policy_{};
+    std::vector<std::vector<std::string>> volumes_;
+    std::shared_ptr<StorageShare> share_;
+
+    // Only accessed by the write thread
+    bool is_reduced_ = false;
+    uint64_t last_check_ns_ = 0;
+    uint64_t last_bytes_ = 0;
+    double write_rate_ = 0.;         // B/s, exponential average
+    double normal_write_rate_ = 0.;  // B/s before the switch to the reduced mode
+    uint64_t num_reduced_candidates_ = 0;
+    std::shared_ptr<std::atomic<uint64_t>> shared_bytes_;
+    uint64_t own_bytes_ = 0;
+
+    std::atomic<double> hours_to_full_ = 0.;
+    std::atomic<uint64_t> min_free_bytes_ = 0;
+    std::atomic<uint64_t> write_rate_kbps_ = 0;
+    std::atomic<size_t> num_mode_switches_ = 0;
+    std::atomic<size_t> num_prescaled_ = 0;
+    std::atomic<bool> reduced_mode_ = false;
+};
+
+} // data_handler
+
+#endif //STORAGE_MANAGER_H
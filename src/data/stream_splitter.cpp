@@ -0,0 +1,91 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "stream_splitter.h"
+#include "fem_data_validator.h"
+#include <algorithm>
+#include <cstring>
+
+namespace data_handler {
+
+    namespace {
+        constexpr uint32_t kEventStartWord = 0xFFFFFFFF;
+        constexpr uint32_t kEventEndWord = 0xE0000000;
+    }
+
+    void StreamSplitter::Configure(const bool enable, const uint32_t light_mask, const size_t max_queued_blocks) {
+        Stop();
+        enable_ = enable;
+        light_mask_ = light_mask;
+        max_queued_blocks_ = max_queued_blocks;
+    }
+
+    bool StreamSplitter::Start() {
+        Stop();
+        if (!enable_) return false;
+        writer_.ResetCounters();
+        light_chunk_.clear();
+        num_light_events_.store(0);
+        num_light_words_.store(0);
+        num_charge_words_.store(0);
+        return writer_.Start(max_queued_blocks_);
+    }
+
+    void StreamSplitter::Stop() {
+        if (writer_.IsRunning()) writer_.Stop();
+    }
+
+    void StreamSplitter::OpenFile(const std::string &file_name, const uint64_t run_number,
+                                  const uint64_t subrun_number, const uint64_t config_hash) {
+        writer_.Open(file_name, run_number, subrun_number, config_hash);
+    }
+
+    size_t StreamSplitter::SplitEvent(uint32_t *words, const size_t num_words) {
+        light_chunk_.push_back(kEventStartWord);
+        const size_t light_begin = light_chunk_.size();
+
+        // Same walk as FemDataValidator::RemoveModules(), the light sub-events are copied out first
+        size_t header_idx = FemDataValidator::FindNextHeader(words, 0, num_words);
+        size_t out_idx = header_idx;
+        while (header_idx < num_words) {
+            const size_t payload_begin = std::min(header_idx + FemDataValidator::kHeaderWords, num_words);
+            const size_t next_header = FemDataValidator::FindNextHeader(words, payload_begin, num_words);
+            // A truncated header at the end of the event stays with the charge data
+            const bool is_light = (payload_begin - header_idx) == FemDataValidator::kHeaderWords &&
+                                  ((light_mask_ >> FemDataValidator::DecodeHeader(words + header_idx).module) & 0x1);
+            if (is_light) {
+                light_chunk_.insert(light_chunk_.end(), words + header_idx, words + next_header);
+            } else {
+                std::memmove(words + out_idx, words + header_idx, (next_header - header_idx) * sizeof(uint32_t));
+                out_idx += next_header - header_idx;
+            }
+            header_idx = next_header;
+        }
+
+        if (light_chunk_.size() > light_begin) num_light_events_++;
+        num_light_words_ += light_chunk_.size() - light_begin;
+        num_charge_words_ += out_idx;
+        light_chunk_.push_back(kEventEndWord);
+        return out_idx;
+    }
+
+    void StreamSplitter::WriteChunk(const uint64_t first_event, const uint64_t last_event) {
+        if (light_chunk_.empty()) return;
+        if (writer_.IsRunning()) writer_.Write(light_chunk_.data(), light_chunk_.size(), first_event, last_event, true);
+        light_chunk_.clear();
+    }
+
+    void StreamSplitter::CloseFile(const bool sync) {
+        if (writer_.IsRunning()) writer_.Close(sync);
+    }
+
+    void StreamSplitter::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["split_light_events"] = num_light_events_.load();
+        metrics["split_light_mb"] = num_light_words_.load() * sizeof(uint32_t) / 1000000;
+        metrics["split_charge_mb"] = num_charge_words_.load() * sizeof(uint32_t) / 1000000;
+        metrics["split_light_written_mb"] = writer_.BytesWritten() / 1000000;
+        metrics["split_light_errors"] = writer_.NumErrors();
+    }
+
+} // data_handler
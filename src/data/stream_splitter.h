@@ -0,0 +1,82 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef STREAM_SPLITTER_H
+#define STREAM_SPLITTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "async_file_writer.h"
+
+namespace data_handler {
+
+/*
+ * Splits the light FEM sub-events out of each event into a separate light stream so the
+ * light-only analyses don't have to read through the charge waveforms.
+ *
+ * The light sub-events are moved out of the event in place, what is left goes to the main
+ * (charge) file as before. Every event gets an entry in the light stream, empty if it had no
+ * light data, so the two streams line up event for event:
+ *
+ *   0xFFFFFFFF  [light FEM sub-events...]  0xE0000000
+ *
+ * The light events of a write chunk go out as one block with the same event range as the
+ * charge block, and a light file is opened with every data file with the same subrun number,
+ * so the block index of either file finds the matching events in the other.
+ *
+ * The light file is written by its own `AsyncFileWriter` thread, blocks are never dropped.
+ * Owned by the write thread, the counters can be read from any thread.
+ */
+class StreamSplitter {
+public:
+
+    StreamSplitter() = default;
+    ~StreamSplitter() = default;
+
+    // Modules set in `light_mask` go to the light stream, only while stopped
+    void Configure(bool enable, uint32_t light_mask, size_t max_queued_blocks);
+    bool IsEnabled() const { return enable_; }
+    void SetContainer(bool use_container) { writer_.SetContainer(use_container); }
+    void SetManifest(bool write_manifest) { writer_.SetManifest(write_manifest); }
+    void SetHeaderFlags(uint32_t flags) { writer_.SetHeaderFlags(flags); }
+    void SetFlusher(FileFlusher *flusher) { writer_.SetFlusher(flusher); }
+
+    bool Start();
+    // Writes out the last file and joins the writer thread
+    void Stop();
+    bool IsRunning() const { return writer_.IsRunning(); }
+
+    // The previous light file is closed by the writer thread
+    void OpenFile(const std::string &file_name, uint64_t run_number, uint64_t subrun_number, uint64_t config_hash);
+    // Move the light sub-events of the words between the event start and end markers (exclusive)
+    // into the light chunk, returns the number of words left in place
+    size_t SplitEvent(uint32_t *words, size_t num_words);
+    // Queue the light events split out since the last chunk as one block
+    void WriteChunk(uint64_t first_event, uint64_t last_event);
+    void CloseFile(bool sync);
+
+    uint64_t NumErrors() const { return writer_.NumErrors(); }
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+private:
+
+    bool enable_ = false;
+    uint32_t light_mask_ = 0;
+    size_t max_queued_blocks_ = 16;
+    AsyncFileWriter writer_{};
+    std::vector<uint32_t> light_chunk_;
+
+    std::atomic<size_t> num_light_events_ = 0;
+    std::atomic<uint64_t> num_light_words_ = 0;
+    std::atomic<uint64_t> num_charge_words_ = 0;
+};
+
+} // data_handler
+
+#endif //STREAM_SPLITTER_H
@@ -0,0 +1,203 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "striped_writer.h"
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+namespace data_handler {
+
+    void StripedWriter::Configure(const std::vector<std::string> &directories, const StripePolicy policy,
+                                  const size_t max_queued_blocks) {
+        Stop();
+        policy_ = policy;
+        max_queued_blocks_ = max_queued_blocks;
+        lanes_.clear();
+        for (const auto &directory : directories) {
+            lanes_.push_back({directory, std::make_unique<AsyncFileWriter>()});
+        }
+    }
+
+    void StripedWriter::SetContainer(const bool use_container) {
+        for (auto &lane : lanes_) lane.writer->SetContainer(use_container);
+    }
+
+    void StripedWriter::SetManifest(const bool write_manifest) {
+        for (auto &lane : lanes_) lane.writer->SetManifest(write_manifest);
+    }
+
+    void StripedWriter::SetHeaderFlags(const uint32_t flags) {
+        for (auto &lane : lanes_) lane.writer->SetHeaderFlags(flags);
+    }
+
+    void StripedWriter::SetFlusher(FileFlusher *flusher) {
+        for (auto &lane : lanes_) lane.writer->SetFlusher(flusher);
+    }
+
+    void StripedWriter::SetLossLedger(LossLedger *loss_ledger) {
+        for (auto &lane : lanes_) lane.writer->SetLossLedger(loss_ledger);
+    }
+
+    bool StripedWriter::ParsePolicy(const std::string &name, StripePolicy &policy) {
+        if (name == "round_robin") policy = StripePolicy::kRoundRobin;
+        else if (name == "free_space") policy = StripePolicy::kFreeSpace;
+        else return false;
+        return true;
+    }
+
+    bool StripedWriter::IsWritable(const std::string &directory) {
+        struct stat stats{};
+        if (stat(directory.c_str(), &stats) != 0 || !S_ISDIR(stats.st_mode)) return false;
+        return access(directory.c_str(), W_OK | X_OK) == 0;
+    }
+
+    bool StripedWriter::Start(const std::string &index_file) {
+        Stop();
+        if (lanes_.empty()) return false;
+        failed_directories_.clear();
+        size_t num_usable = 0;
+        for (auto &lane : lanes_) {
+            lane.writer->ResetCounters();
+            lane.num_open_errors = 0;
+            lane.failed = !IsWritable(lane.directory);
+            if (lane.failed) failed_directories_.push_back(lane.directory);
+            else num_usable++;
+        }
+        if (num_usable == 0) return false;
+        for (auto &lane : lanes_) {
+            if (!lane.failed) lane.writer->Start(max_queued_blocks_);
+        }
+        index_.open(index_file, std::ios::out | std::ios::trunc);
+        next_lane_ = 0;
+        file_open_ = false;
+        running_ = true;
+        return index_.is_open();
+    }
+
+    void StripedWriter::Stop() {
+        if (!running_) return;
+        // Each writer finishes its queue and syncs its last file
+        for (auto &lane : lanes_) lane.writer->Stop();
+        if (index_.is_open()) index_.close();
+        file_open_ = false;
+        running_ = false;
+    }
+
+    void StripedWriter::CheckLanes() {
+        for (size_t i = 0; i < lanes_.size(); i++) {
+            if (!lanes_[i].failed && lanes_[i].writer->NumOpenErrors() != lanes_[i].num_open_errors) FailLane(i);
+        }
+    }
+
+    void StripedWriter::FailLane(const size_t lane) {
+        // The writer keeps running, what is still queued to it is recorded as lost
+        lanes_[lane].failed = true;
+        lanes_[lane].num_open_errors = lanes_[lane].writer->NumOpenErrors();
+        failed_directories_.push_back(lanes_[lane].directory);
+    }
+
+    std::vector<std::string> StripedWriter::TakeFailedDirectories() {
+        std::vector<std::string> directories;
+        directories.swap(failed_directories_);
+        return directories;
+    }
+
+    size_t StripedWriter::NextLane() {
+        if (policy_ == StripePolicy::kFreeSpace) {
+            size_t best_lane = lanes_.size();
+            uint64_t best_free = 0;
+            for (size_t i = 0; i < lanes_.size(); i++) {
+                if (lanes_[i].failed) continue;
+                if (best_lane == lanes_.size()) best_lane = i;
+                struct statvfs stats{};
+                if (statvfs(lanes_[i].directory.c_str(), &stats) != 0) continue;
+                const uint64_t free_bytes = static_cast<uint64_t>(stats.f_bavail) * stats.f_frsize;
+                if (free_bytes > best_free) {
+                    best_free = free_bytes;
+                    best_lane = i;
+                }
+            }
+            return best_lane;
+        }
+        for (size_t i = 0; i < lanes_.size(); i++) {
+            const size_t lane = next_lane_ % lanes_.size();
+            next_lane_++;
+            if (!lanes_[lane].failed) return lane;
+        }
+        return lanes_.size();
+    }
+
+    std::string StripedWriter::OpenOnNextLane() {
+        while (true) {
+            active_lane_ = NextLane();
+            if (active_lane_ == lanes_.size()) return "";
+            // Catch a directory which went away or read only before the file is queued to it
+            if (!IsWritable(lanes_[active_lane_].directory)) {
+                FailLane(active_lane_);
+                continue;
+            }
+            const std::string path = lanes_[active_lane_].directory + "/" + file_name_;
+            lanes_[active_lane_].writer->Open(path, run_number_, subrun_number_, config_hash_);
+            file_open_ = true;
+            if (index_.is_open()) index_ << subrun_number_ << " " << path << std::endl;
+            return path;
+        }
+    }
+
+    std::string StripedWriter::OpenFile(const std::string &file_name, const uint64_t run_number,
+                                        const uint64_t subrun_number, const uint64_t config_hash) {
+        if (file_open_) CloseFile(false);
+        CheckLanes();
+        file_name_ = file_name;
+        run_number_ = run_number;
+        subrun_number_ = subrun_number;
+        config_hash_ = config_hash;
+        return OpenOnNextLane();
+    }
+
+    ssize_t StripedWriter::WriteBlock(const uint32_t *words, const size_t num_words,
+                                      const uint64_t first_event, const uint64_t last_event) {
+        if (!file_open_) return -1;
+        if (lanes_[active_lane_].writer->NumOpenErrors() != lanes_[active_lane_].num_open_errors) {
+            FailLane(active_lane_);
+            file_open_ = false;
+            if (OpenOnNextLane().empty()) return -1;
+        }
+        lanes_[active_lane_].writer->Write(words, num_words, first_event, last_event, true);
+        return static_cast<ssize_t>(num_words * sizeof(uint32_t));
+    }
+
+    void StripedWriter::CloseFile(const bool sync) {
+        if (!file_open_) return;
+        lanes_[active_lane_].writer->Close(sync);
+        file_open_ = false;
+    }
+
+    uint64_t StripedWriter::ChecksumNs() const {
+        uint64_t checksum_ns = 0;
+        for (const auto &lane : lanes_) checksum_ns += lane.writer->ChecksumNs();
+        return checksum_ns;
+    }
+
+    uint64_t StripedWriter::NumErrors() const {
+        uint64_t num_errors = 0;
+        for (const auto &lane : lanes_) num_errors += lane.writer->NumErrors();
+        return num_errors;
+    }
+
+    void StripedWriter::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        size_t full_waits = 0;
+        for (size_t i = 0; i < lanes_.size(); i++) {
+            const std::string prefix = "stripe_" + std::to_string(i);
+            metrics[prefix + "_mb"] = lanes_[i].writer->BytesWritten() / 1000000;
+            metrics[prefix + "_files"] = lanes_[i].writer->NumFiles();
+            metrics[prefix + "_max_queued"] = lanes_[i].writer->MaxQueued();
+            full_waits += lanes_[i].writer->NumFullWaits();
+        }
+        metrics["stripe_full_waits"] = full_waits;
+        metrics["stripe_errors"] = NumErrors();
+    }
+
+} // data_handler
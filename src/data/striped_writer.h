@@ -0,0 +1,115 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef STRIPED_WRITER_H
+#define STRIPED_WRITER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "async_file_writer.h"
+
+namespace data_handler {
+
+enum class StripePolicy : uint8_t {
+    kRoundRobin = 0,
+    kFreeSpace = 1,  // the directory with the most free space
+};
+
+/*
+ * Stripes the data files of a run over several output directories, ideally each on its own
+ * disk. Every directory has its own `AsyncFileWriter` thread; each new file goes to the next
+ * directory (round robin, or the one with the most free space) and the previous file is
+ * finished by its own thread in the background. While one disk works through its queue the
+ * others take the next files, so the sustained rate scales with the number of disks.
+ *
+ * The directory of each file is appended to an index file, one line per file
+ * "<file number> <path>", so the files of a run can be found again.
+ *
+ * A directory which is missing or not writable at the start, or where a file fails to open,
+ * is left out of the rotation for the rest of the run. A file whose open failed is opened
+ * again in the next directory (and listed again in the index); the blocks already queued to
+ * the failed directory are recorded in the `LossLedger` as kWriteFailed.
+ *
+ * Owned by the write thread, the metrics can be read from any thread.
+ */
+class StripedWriter {
+public:
+
+    StripedWriter() = default;
+    ~StripedWriter() = default;
+
+    // Set up the output directories, only while stopped
+    void Configure(const std::vector<std::string> &directories, StripePolicy policy, size_t max_queued_blocks);
+    bool IsEnabled() const { return !lanes_.empty(); }
+    void SetContainer(bool use_container);
+    void SetManifest(bool write_manifest);
+    void SetHeaderFlags(uint32_t flags);
+    void SetFlusher(FileFlusher *flusher);
+    void SetLossLedger(LossLedger *loss_ledger);
+
+    // Not running if no directory is usable, false if it isn't running or the index didn't open
+    bool Start(const std::string &index_file);
+    void Stop();
+    bool IsRunning() const { return running_; }
+
+    // Open `file_name` in the next directory, returns its full path or "" if none is left
+    std::string OpenFile(const std::string &file_name, uint64_t run_number, uint64_t subrun_number, uint64_t config_hash);
+    // Queue a block for the current file, waits while its directory queue is full.
+    // Returns the number of bytes queued or -1 if no file is open.
+    // Moves the file to the next directory first if its open failed.
+    ssize_t WriteBlock(const uint32_t *words, size_t num_words, uint64_t first_event, uint64_t last_event);
+    void CloseFile(bool sync);
+
+    uint64_t ChecksumNs() const;
+    uint64_t NumErrors() const;
+    // The directories left out since the last call, for the caller to report
+    std::vector<std::string> TakeFailedDirectories();
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+    static bool ParsePolicy(const std::string &name, StripePolicy &policy);
+
+private:
+
+    struct Lane {
+        std::string directory;
+        std::unique_ptr<AsyncFileWriter> writer;
+        bool failed = false;
+        uint64_t num_open_errors = 0;
+    };
+
+    static bool IsWritable(const std::string &directory);
+    // Leave out the lanes with a failed open
+    void CheckLanes();
+    void FailLane(size_t lane);
+    // lanes_.size() if every lane failed
+    size_t NextLane();
+    std::string OpenOnNextLane();
+
+    std::vector<Lane> lanes_;
+    StripePolicy policy_ = StripePolicy::kRoundRobin;
+    size_t max_queued_blocks_ = 8;
+    bool running_ = false;
+    size_t next_lane_ = 0;
+    size_t active_lane_ = 0;
+    bool file_open_ = false;
+    std::ofstream index_;
+    std::vector<std::string> failed_directories_;
+
+    // The current file, to open it again in another directory
+    std::string file_name_;
+    uint64_t run_number_ = 0;
+    uint64_t subrun_number_ = 0;
+    uint64_t config_hash_ = 0;
+};
+
+} // data_handler
+
+#endif //STRIPED_WRITER_H
@@ -0,0 +1,276 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#include "zero_suppression.h"
+#include "fem_data_validator.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace data_handler {
+
+    namespace {
+        constexpr uint16_t kUnknownPedestal = 0xFFFF;
+        // 0x6000, start, length
+        constexpr size_t kRoiHeaderHalves = 3;
+
+        bool IsMarker(const uint16_t half, const uint16_t marker) {
+            return (half & ZeroSuppressor::kMarkerMask) == marker;
+        }
+
+        // Inverse of `FemDataValidator::HeaderValue`, keeps the flag bits of the word
+        void SetHeaderValue(uint32_t &word, const uint32_t value) {
+            word = (word & 0xF000F000) | ((value & 0xFFF) << 16) | ((value >> 12) & 0xFFF);
+        }
+
+        // Copy the halves back to 32b words, padding an odd count with 0 as the FEM does
+        // and fix up the header word count and checksum. Returns the number of payload words.
+        size_t StorePayload(std::vector<uint16_t> &halves, uint32_t *header, uint32_t *payload) {
+            const size_t num_halves = halves.size();
+            if (num_halves % 2) halves.push_back(0);
+            const size_t num_words = halves.size() / 2;
+            std::memcpy(payload, halves.data(), num_words * sizeof(uint32_t));
+            SetHeaderValue(header[1], static_cast<uint32_t>(num_halves));
+            SetHeaderValue(header[4], FemDataValidator::ComputeChecksum(payload, num_words));
+            return num_words;
+        }
+    }
+
+    void ZeroSuppressor::Configure(const bool enable, const uint32_t threshold, const size_t pre_samples,
+                                   const size_t post_samples, const size_t baseline_samples,
+                                   const uint32_t first_module, const uint32_t last_module) {
+        enable_ = enable;
+        threshold_ = threshold;
+        pre_samples_ = pre_samples;
+        post_samples_ = post_samples;
+        baseline_samples_ = std::max(baseline_samples, size_t{1});
+        first_module_ = first_module;
+        last_module_ = std::min(last_module, static_cast<uint32_t>(kMaxModules - 1));
+        for (auto &module : pedestals_) module.fill(kUnknownPedestal);
+    }
+
+    bool ZeroSuppressor::LoadPedestals(const std::string &file_name) {
+        std::ifstream file(file_name);
+        if (!file.is_open()) return false;
+        try {
+            const nlohmann::json table = nlohmann::json::parse(file);
+            // Also takes the pedestal monitor snapshots, {"mean": {...}, "rms": {...}}
+            const nlohmann::json &pedestals = table.contains("mean") ? table["mean"] : table;
+            for (const auto &[module, channels] : pedestals.items()) {
+                const auto module_num = std::stoul(module);
+                if (module_num >= kMaxModules) continue;
+                for (size_t ch = 0; ch < std::min(channels.size(), kMaxChannels); ch++) {
+                    if (!channels[ch].is_number()) continue;
+                    pedestals_[module_num][ch] = static_cast<uint16_t>(channels[ch].get<double>() + 0.5);
+                }
+            }
+        } catch (std::exception &e) {
+            return false;
+        }
+        return true;
+    }
+
+    void ZeroSuppressor::Reset() {
+        num_events_.store(0);
+        words_in_.store(0);
+        words_out_.store(0);
+        channels_suppressed_.store(0);
+        channels_kept_.store(0);
+    }
+
+    uint16_t ZeroSuppressor::Baseline(const uint32_t module, const uint32_t channel,
+                                      const uint16_t *samples, const size_t num_samples) {
+        if (channel < kMaxChannels && pedestals_[module][channel] != kUnknownPedestal) {
+            return pedestals_[module][channel];
+        }
+        if (num_samples == 0) return 0;
+        // Median of the first samples, robust against a pulse at the start of the window
+        const size_t n = std::min(num_samples, baseline_samples_);
+        baseline_scratch_.assign(samples, samples + n);
+        std::nth_element(baseline_scratch_.begin(), baseline_scratch_.begin() + n / 2, baseline_scratch_.end());
+        return baseline_scratch_[n / 2];
+    }
+
+    bool ZeroSuppressor::SuppressChannel(const uint32_t module, const uint16_t channel_word, const uint16_t end_word,
+                                         const uint16_t *samples, const size_t num_samples, std::vector<uint16_t> &out) {
+        // Keep the sample count and positions clear of the marker values
+        if (num_samples >= kMarkerMask) return false;
+        for (size_t s = 0; s < num_samples; s++) {
+            if (samples[s] & kMarkerMask) return false; // not plain 12b samples, leave it alone
+        }
+
+        const uint16_t baseline = Baseline(module, channel_word & 0x3F, samples, num_samples);
+        rois_.clear();
+        for (size_t s = 0; s < num_samples; s++) {
+            const int deviation = static_cast<int>(samples[s]) - static_cast<int>(baseline);
+            if (static_cast<uint32_t>(std::abs(deviation)) <= threshold_) continue;
+            const size_t start = s > pre_samples_ ? s - pre_samples_ : 0;
+            const size_t end = std::min(num_samples, s + post_samples_ + 1);
+            // Merge when the gap is no bigger than the header of a new region
+            if (!rois_.empty() && start <= rois_.back().start + rois_.back().length + kRoiHeaderHalves) {
+                rois_.back().length = std::max(rois_.back().start + rois_.back().length, end) - rois_.back().start;
+            } else {
+                rois_.push_back({start, end - start});
+            }
+        }
+
+        size_t suppressed_size = 4; // channel start & end, baseline and sample count
+        for (const auto &roi : rois_) suppressed_size += kRoiHeaderHalves + roi.length;
+        if (suppressed_size >= num_samples + 2) return false;
+
+        out.push_back(channel_word);
+        out.push_back(kSuppressed | baseline);
+        out.push_back(static_cast<uint16_t>(num_samples));
+        for (const auto &roi : rois_) {
+            out.push_back(kRoiStart);
+            out.push_back(static_cast<uint16_t>(roi.start));
+            out.push_back(static_cast<uint16_t>(roi.length));
+            out.insert(out.end(), samples + roi.start, samples + roi.start + roi.length);
+        }
+        out.push_back(end_word);
+        return true;
+    }
+
+    void ZeroSuppressor::SuppressFem(const uint32_t module, const uint16_t *in, const size_t num_in,
+                                     std::vector<uint16_t> &out) {
+        size_t i = 0;
+        while (i < num_in) {
+            if (!IsMarker(in[i], kChannelStart)) {
+                out.push_back(in[i++]);
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < num_in && !IsMarker(in[end], kChannelEnd) && !IsMarker(in[end], kChannelStart)) end++;
+            if (end == num_in || !IsMarker(in[end], kChannelEnd)) {
+                // Unterminated channel, pass it through
+                out.insert(out.end(), in + i, in + end);
+                i = end;
+                continue;
+            }
+            if (SuppressChannel(module, in[i], in[end], in + i + 1, end - i - 1, out)) {
+                channels_suppressed_++;
+            } else {
+                out.insert(out.end(), in + i, in + end + 1);
+                channels_kept_++;
+            }
+            i = end + 1;
+        }
+    }
+
+    size_t ZeroSuppressor::SuppressEvent(uint32_t *words, const size_t num_words) {
+        if (!enable_) return num_words;
+        num_events_++;
+        words_in_ += num_words;
+
+        // Anything before the first FEM header stays where it is
+        size_t header_idx = FemDataValidator::FindNextHeader(words, 0, num_words);
+        size_t out_idx = header_idx;
+        while (header_idx < num_words) {
+            if (header_idx + FemDataValidator::kHeaderWords > num_words) {
+                std::memmove(words + out_idx, words + header_idx, (num_words - header_idx) * sizeof(uint32_t));
+                out_idx += num_words - header_idx;
+                break;
+            }
+            const FemDataValidator::FemHeader header = FemDataValidator::DecodeHeader(words + header_idx);
+            const size_t payload_begin = header_idx + FemDataValidator::kHeaderWords;
+            const size_t next_header = FemDataValidator::FindNextHeader(words, payload_begin, num_words);
+            const size_t payload_words = next_header - payload_begin;
+
+            // The output never grows so it can be compacted in place, behind the read position
+            uint32_t *header_out = words + out_idx;
+            std::memmove(header_out, words + header_idx, FemDataValidator::kHeaderWords * sizeof(uint32_t));
+            out_idx += FemDataValidator::kHeaderWords;
+
+            const bool is_charge = header.module >= first_module_ && header.module <= last_module_;
+            const bool is_consistent = ((header.word_count + 1) / 2) == payload_words;
+            if (is_charge && is_consistent) {
+                in_halves_.resize(2 * payload_words);
+                std::memcpy(in_halves_.data(), words + payload_begin, payload_words * sizeof(uint32_t));
+                out_halves_.clear();
+                SuppressFem(header.module, in_halves_.data(), header.word_count, out_halves_);
+                out_idx += StorePayload(out_halves_, header_out, words + out_idx);
+            } else {
+                // Light data or a FEM which already failed its integrity check, pass it through
+                std::memmove(words + out_idx, words + payload_begin, payload_words * sizeof(uint32_t));
+                out_idx += payload_words;
+            }
+            header_idx = next_header;
+        }
+        words_out_ += out_idx;
+        return out_idx;
+    }
+
+    bool ZeroSuppressor::ExpandEvent(const uint32_t *words, const size_t num_words, std::vector<uint32_t> &expanded) {
+        expanded.clear();
+        size_t header_idx = FemDataValidator::FindNextHeader(words, 0, num_words);
+        expanded.insert(expanded.end(), words, words + header_idx);
+        std::vector<uint16_t> in, out;
+        bool ok = true;
+
+        while (header_idx < num_words) {
+            const size_t payload_begin = std::min(header_idx + FemDataValidator::kHeaderWords, num_words);
+            const size_t next_header = FemDataValidator::FindNextHeader(words, payload_begin, num_words);
+            const size_t header_out = expanded.size();
+            expanded.insert(expanded.end(), words + header_idx, words + payload_begin);
+            if (payload_begin - header_idx < FemDataValidator::kHeaderWords) break;
+
+            const size_t payload_words = next_header - payload_begin;
+            const FemDataValidator::FemHeader header = FemDataValidator::DecodeHeader(words + header_idx);
+            if (((header.word_count + 1) / 2) != payload_words) {
+                expanded.insert(expanded.end(), words + payload_begin, words + next_header);
+                header_idx = next_header;
+                ok = false;
+                continue;
+            }
+
+            in.resize(2 * payload_words);
+            std::memcpy(in.data(), words + payload_begin, payload_words * sizeof(uint32_t));
+            out.clear();
+            bool has_suppressed = false;
+            size_t i = 0;
+            while (i < header.word_count) {
+                if (!IsMarker(in[i], kChannelStart) || i + 2 >= header.word_count || !IsMarker(in[i + 1], kSuppressed)) {
+                    out.push_back(in[i++]);
+                    continue;
+                }
+                has_suppressed = true;
+                const uint16_t baseline = in[i + 1] & 0x0FFF;
+                const size_t num_samples = in[i + 2];
+                out.push_back(in[i]);
+                const size_t samples_begin = out.size();
+                out.resize(samples_begin + num_samples, baseline);
+                i += 3;
+                while (i + 2 < header.word_count && IsMarker(in[i], kRoiStart)) {
+                    const size_t start = in[i + 1], length = in[i + 2];
+                    i += 3;
+                    if (start + length > num_samples || i + length > header.word_count) return false;
+                    std::copy(in.begin() + i, in.begin() + i + length, out.begin() + samples_begin + start);
+                    i += length;
+                }
+                if (i >= header.word_count || !IsMarker(in[i], kChannelEnd)) return false;
+                out.push_back(in[i++]);
+            }
+
+            if (has_suppressed) {
+                expanded.resize(header_out + FemDataValidator::kHeaderWords + (out.size() + 1) / 2);
+                StorePayload(out, expanded.data() + header_out, expanded.data() + header_out + FemDataValidator::kHeaderWords);
+            } else {
+                expanded.insert(expanded.end(), words + payload_begin, words + next_header);
+            }
+            header_idx = next_header;
+        }
+        return ok;
+    }
+
+    void ZeroSuppressor::AddMetrics(std::map<std::string, size_t> &metrics) const {
+        metrics["zs_events"] = num_events_.load();
+        metrics["zs_words_in"] = words_in_.load();
+        metrics["zs_words_out"] = words_out_.load();
+        metrics["zs_channels_suppressed"] = channels_suppressed_.load();
+        metrics["zs_channels_kept"] = channels_kept_.load();
+    }
+
+} // data_handler
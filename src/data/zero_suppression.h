@@ -0,0 +1,107 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+#ifndef ZERO_SUPPRESSION_H
+#define ZERO_SUPPRESSION_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace data_handler {
+
+/*
+ * Online zero suppression of the charge FEM channels.
+ *
+ * The FEM payload is a stream of 16b words (in memory order, the low half of each 32b word
+ * first). A channel is framed by 0x4000|ch and 0x5000|ch with the 12b ADC samples in between.
+ * For each channel the baseline is taken from the pedestal table if there is one, otherwise
+ * the median of its first samples. Samples further than `threshold` from the baseline open a
+ * region of interest which is extended by the pre/post padding, regions closer than a ROI
+ * header are merged. A suppressed channel is written as
+ *
+ *   0x4000|ch  0x7000|baseline  num_samples  [0x6000  start  length  samples...]...  0x5000|ch
+ *
+ * so the waveform can be rebuilt with `ExpandEvent()`, the suppressed samples set to the
+ * baseline. A channel is left as is if suppressing it would not make it smaller. The FEM
+ * header word count and checksum are rewritten to match the new payload, the data is checked
+ * by the `FemDataValidator` before it is suppressed.
+ *
+ * Only modules in [first_module, last_module] are touched, the light FEM data is passed through.
+ * Called from the write thread only, the counters can be read from any thread.
+ */
+class ZeroSuppressor {
+public:
+
+    ZeroSuppressor() = default;
+    ~ZeroSuppressor() = default;
+
+    void Configure(bool enable, uint32_t threshold, size_t pre_samples, size_t post_samples,
+                   size_t baseline_samples, uint32_t first_module, uint32_t last_module);
+    // Pedestal table json {"<module>": [baseline of channel 0, 1, ...]} or a `PedestalMonitor` snapshot,
+    // returns false if it can't be read
+    bool LoadPedestals(const std::string &file_name);
+    bool IsEnabled() const { return enable_; }
+    void Reset();
+
+    // Suppress the words between the event start and end markers (exclusive) in place,
+    // returns the new number of words
+    size_t SuppressEvent(uint32_t *words, size_t num_words);
+
+    // Rebuild the full waveforms of a suppressed event, unsuppressed data is copied as is
+    static bool ExpandEvent(const uint32_t *words, size_t num_words, std::vector<uint32_t> &expanded);
+
+    void AddMetrics(std::map<std::string, size_t> &metrics) const;
+
+    static constexpr uint16_t kChannelStart = 0x4000;
+    static constexpr uint16_t kChannelEnd = 0x5000;
+    static constexpr uint16_t kRoiStart = 0x6000;
+    static constexpr uint16_t kSuppressed = 0x7000;
+    static constexpr uint16_t kMarkerMask = 0xF000;
+    static constexpr size_t kMaxChannels = 64;
+    static constexpr size_t kMaxModules = 32;
+
+private:
+
+    struct Roi {
+        size_t start;
+        size_t length;
+    };
+
+    void SuppressFem(uint32_t module, const uint16_t *in, size_t num_in, std::vector<uint16_t> &out);
+    bool SuppressChannel(uint32_t module, uint16_t channel_word, uint16_t end_word, const uint16_t *samples,
+                         size_t num_samples, std::vector<uint16_t> &out);
+    uint16_t Baseline(uint32_t module, uint32_t channel, const uint16_t *samples, size_t num_samples);
+
+    bool enable_ = false;
+    uint32_t threshold_ = 10;
+    size_t pre_samples_ = 8;
+    size_t post_samples_ = 16;
+    size_t baseline_samples_ = 16;
+    uint32_t first_module_ = 0;
+    uint32_t last_module_ = kMaxModules - 1;
+
+    // Pedestals per module and channel, 0xFFFF if unknown
+    std::array<std::array<uint16_t, kMaxChannels>, kMaxModules> pedestals_{};
+
+    // Scratch buffers reused between events
+    std::vector<uint16_t> in_halves_;
+    std::vector<uint16_t> out_halves_;
+    std::vector<uint16_t> baseline_scratch_;
+    std::vector<Roi> rois_;
+
+    std::atomic<size_t> num_events_ = 0;
+    std::atomic<size_t> words_in_ = 0;
+    std::atomic<size_t> words_out_ = 0;
+    std::atomic<size_t> channels_suppressed_ = 0;
+    std::atomic<size_t> channels_kept_ = 0;
+};
+
+} // data_handler
+
+#endif //ZERO_SUPPRESSION_H
@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
 
 namespace trig_ctrl {
 
@@ -162,7 +163,7 @@ namespace trig_ctrl {
     }
 
     void TriggerControl::SendStartTrigger(pcie_int::PCIeInterface *pcie_interface, int itrig_c, int itrig_ext, int trigger_module) {
-        static int imod, ichip;
+        int imod = 0, ichip = 0;
         // static int imod_trig   = 11;
         std::array<uint32_t, 2> buf_send{0,0};
         uint32_t *psend{};
@@ -189,7 +190,7 @@ namespace trig_ctrl {
     }
 
     void TriggerControl::SendStopTrigger(pcie_int::PCIeInterface *pcie_interface, int itrig_c, int itrig_ext, int trigger_module) {
-        static int imod;
+        int imod = 0;
         // static int imod_trig   = 11;
         std::array<uint32_t, 2> buf_send{0,0};
         uint32_t *psend{};
@@ -224,11 +225,19 @@ namespace trig_ctrl {
         buf_send[0] = (trigger_module << 11) + (hw_consts::mb_trig_pctrig) + ((0x0) << 16);
         // buf_send[0] = (trigger_module << 11) + (hw_consts::mb_trig_calib) + ((0x0) << 16);
 
+        // Sleep in short steps so a run stop is seen promptly, even at low trigger rates
+        const auto max_sleep_step = std::chrono::microseconds(10000);
         while (is_running_.load()) {
-            std::this_thread::sleep_for(sleep_length);
+            const auto wake_time = std::chrono::steady_clock::now() + sleep_length;
+            while (is_running_.load() && std::chrono::steady_clock::now() < wake_time) {
+                std::this_thread::sleep_for(std::min(max_sleep_step, sleep_length));
+            }
+            if (!is_running_.load()) break;
             // std::this_thread::sleep_for(std::chrono::milliseconds(1000));
             //LOG_INFO(logger_, "Sending software trigger, length={}", sleep_length.count());
             // std::cout << "Sending software trigger, sleep length=" << sleep_length.count() << "us" << std::endl;
+            // While paused keep the thread alive but don't send triggers
+            if (is_paused_.load()) continue;
             pcie_interface->PCIeSendBuffer(kDev1, 1, 1, psend);
         }
     }
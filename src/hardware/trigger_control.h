@@ -19,6 +19,9 @@ public:
     uint32_t Configure(json &config, pcie_int::PCIeInterface *pcie_interface, pcie_int::PcieBuffers &buffers) override;
     std::vector<uint32_t> GetStatus() override;
     void StopTrigger(const bool stop_trigger) { is_running_.store(!stop_trigger); }
+    // Hold off the software triggers without stopping the trigger thread, used for backpressure
+    void PauseTrigger(const bool pause_trigger) { is_paused_.store(pause_trigger); }
+    bool IsPaused() const { return is_paused_.load(); }
 
     static void SendStartTrigger(pcie_int::PCIeInterface *pcie_interface, int itrig_c, int itrig_ext, int trigger_module);
     static void SendStopTrigger(pcie_int::PCIeInterface *pcie_interface, int itrig_c, int itrig_ext, int trigger_module);
@@ -28,6 +31,7 @@ private:
 
     quill::Logger* logger_;
     std::atomic_bool is_running_ = false;
+    std::atomic_bool is_paused_ = false;
     std::vector<uint32_t> prescale_vec_;
     int software_trigger_rate_{};
     int trigger_module_;
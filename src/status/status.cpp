@@ -14,15 +14,38 @@ using json = nlohmann::json;
 
     void Status::SetDataHandlerStatus(data_handler::DataHandler *data_handler) {
         data_handler_metrics_ = data_handler->GetMetrics();
+        data_handler_tables_ = json::object();
+        SampleTables(data_handler, "");
     }
 
-//    std::string Status::JsonHandlerStatus() {
-    std::string Status::JsonHandlerStatus(data_handler::DataHandler *data_handler) {
-      	auto metrics = data_handler->GetMetrics();
-		json json_metrics;
-		for (const auto& pair : data_handler_metrics_) {
-    		json_metrics[pair.first] = pair.second;
-		}
+    void Status::AddDataHandlerStatus(data_handler::DataHandler *data_handler, const std::string &prefix) {
+        for (const auto &[name, value] : data_handler->GetMetrics()) {
+            data_handler_metrics_[prefix + name] = value;
+        }
+        SampleTables(data_handler, prefix);
+    }
+
+    void Status::SampleTables(data_handler::DataHandler *data_handler, const std::string &prefix) {
+        // The pedestal table is large and only changes once a snapshot period, send each once.
+        // The snapshot numbers start over with every run, so the time tells them apart.
+        const auto snapshot = data_handler->GetPedestalSnapshot();
+        const std::pair<uint64_t, uint64_t> snapshot_id{snapshot.number, snapshot.time_s};
+        if (snapshot.number > 0 && snapshot_id != sent_pedestal_snapshots_[prefix]) {
+            data_handler_tables_[prefix + "pedestal_snapshot"] = data_handler::PedestalMonitor::SnapshotJson(snapshot);
+            sent_pedestal_snapshots_[prefix] = snapshot_id;
+        }
+        // The occupancy covers one period, about the status cadence, so it goes out every time,
+        // packed per module as [module, num_events, num_channels, hits of each channel...]
+        const std::vector<uint32_t> histogram = data_handler->GetOccupancyHistogram();
+        if (!histogram.empty()) data_handler_tables_[prefix + "occupancy_histogram"] = histogram;
+    }
+
+    std::string Status::JsonHandlerStatus() {
+        json json_metrics;
+        for (const auto& pair : data_handler_metrics_) {
+            json_metrics[pair.first] = pair.second;
+        }
+        json_metrics.update(data_handler_tables_);
         return json_metrics.dump();
     }
 
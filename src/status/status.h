@@ -8,6 +8,7 @@
 #include "pcie_interface.h"
 #include "../src/data/data_handler.h"
 #include "tpc_readout_monitor.h"
+#include "json.hpp"
 #include <vector>
 #include <cstdint>
 #include <atomic>
@@ -25,7 +26,12 @@ public:
     void ReadStatus(TpcReadoutMonitor &tpc_monitor, const std::vector<int>& boards,
                     pcie_int::PCIeInterface *pcie_interface, bool minimal_status);
     void SetDataHandlerStatus(data_handler::DataHandler *data_handler);
-    std::string JsonHandlerStatus(data_handler::DataHandler *data_handler);
+    // Add the metrics of another card pair's pipeline, each key prefixed with `prefix`
+    void AddDataHandlerStatus(data_handler::DataHandler *data_handler, const std::string &prefix);
+    // The sampled metrics of all the card pairs as a json object, with the pedestal tables
+    // (<prefix>pedestal_snapshot) of the snapshots taken since the last sample and the packed
+    // occupancy histograms (<prefix>occupancy_histogram)
+    std::string JsonHandlerStatus();
     void SetPrintStatus(const bool print) { print_status_ = print; }
 
 private:
@@ -33,12 +39,16 @@ private:
     std::vector<uint32_t> GetFemStatus(uint32_t board_number, pcie_int::PCIeInterface *pcie_interface);
     bool CheckFemStatus(std::vector<uint32_t>& status_vec, uint32_t board_num);
     bool CheckXmitStatus(std::vector<uint32_t>& status_vec);
+    void SampleTables(data_handler::DataHandler *data_handler, const std::string &prefix);
 
     bool print_status_;
     uint32_t fem_status_chip_ = 3;
     uint32_t fem_status_num_word_ = 1;
     std::vector<uint32_t> data_handler_status_vec_;
     std::map<std::string, size_t> data_handler_metrics_{};
+    // Sent with the metrics, keyed by card pair prefix
+    nlohmann::json data_handler_tables_ = nlohmann::json::object();
+    std::map<std::string, std::pair<uint64_t, uint64_t>> sent_pedestal_snapshots_{};
 
 };
 
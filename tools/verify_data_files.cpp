@@ -0,0 +1,145 @@
+//
+// Created by Jon Sensenig on 10/19/26.
+//
+
+// Verify readout data files against their CRC32C checksums.
+//
+//   verify_data_files [-j <threads>] <file.dat> [<file.dat> ...]
+//
+// Uses the <file>.crc32c manifest when there is one, otherwise the block CRCs of the
+// container format. The chunks of all the files are checked in parallel, exits non-zero
+// if any chunk is bad or a file could not be checked.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/data/crc32c.h"
+#include "../src/data/data_file.h"
+
+namespace {
+
+    struct FileToCheck {
+        std::string name;
+        int fd = -1;
+        bool loaded = false;
+        std::vector<data_handler::ChecksumEntry> chunks;
+        std::atomic<size_t> num_bad = 0;
+        std::atomic<size_t> num_bytes = 0;
+    };
+
+    struct ChunkTask {
+        size_t file_num;
+        size_t chunk_num;
+    };
+
+    // Build the list of chunks to check for one file, from the manifest or the container blocks
+    bool LoadChunks(FileToCheck &file) {
+        if (data_handler::ReadManifest(file.name + data_handler::kManifestSuffix, file.chunks)) return true;
+
+        data_handler::DataFileReader reader;
+        if (!reader.Open(file.name)) return false;
+        const auto &index = reader.Index();
+        for (size_t i = 0; i < index.size(); i++) {
+            data_handler::BlockHeader block_header{};
+            if (pread(file.fd, &block_header, sizeof(block_header), static_cast<off_t>(index[i].offset)) !=
+                static_cast<ssize_t>(sizeof(block_header))) return false;
+            file.chunks.push_back({index[i].offset + block_header.header_size, block_header.payload_bytes,
+                                   block_header.payload_crc});
+        }
+        return true;
+    }
+
+    bool CheckChunk(const int fd, const data_handler::ChecksumEntry &chunk, std::vector<char> &buffer) {
+        buffer.resize(chunk.num_bytes);
+        size_t done = 0;
+        while (done < chunk.num_bytes) {
+            const ssize_t n = pread(fd, buffer.data() + done, chunk.num_bytes - done,
+                                    static_cast<off_t>(chunk.offset + done));
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) return false; // truncated file
+            done += static_cast<size_t>(n);
+        }
+        return data_handler::Crc32c(buffer.data(), buffer.size()) == chunk.crc;
+    }
+
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> file_names;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            num_threads = std::max(1, std::atoi(argv[++i]));
+        } else {
+            file_names.push_back(arg);
+        }
+    }
+    if (file_names.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-j <threads>] <file.dat> [<file.dat> ...]" << std::endl;
+        return 2;
+    }
+
+    std::vector<FileToCheck> files(file_names.size());
+    std::vector<ChunkTask> tasks;
+    bool all_ok = true;
+    for (size_t f = 0; f < files.size(); f++) {
+        files[f].name = file_names[f];
+        files[f].fd = open(files[f].name.c_str(), O_RDONLY);
+        if (files[f].fd == -1) {
+            std::cerr << files[f].name << ": failed to open, " << std::strerror(errno) << std::endl;
+            all_ok = false;
+            continue;
+        }
+        if (!LoadChunks(files[f])) {
+            std::cerr << files[f].name << ": no manifest or container index, cannot check" << std::endl;
+            all_ok = false;
+            continue;
+        }
+        files[f].loaded = true;
+        for (size_t c = 0; c < files[f].chunks.size(); c++) tasks.push_back({f, c});
+    }
+
+    std::atomic<size_t> next_task = 0;
+    std::mutex print_mutex;
+    auto worker = [&]() {
+        std::vector<char> buffer;
+        for (size_t t = next_task++; t < tasks.size(); t = next_task++) {
+            FileToCheck &file = files[tasks[t].file_num];
+            const auto &chunk = file.chunks[tasks[t].chunk_num];
+            if (CheckChunk(file.fd, chunk, buffer)) {
+                file.num_bytes += chunk.num_bytes;
+            } else {
+                file.num_bad++;
+                std::lock_guard<std::mutex> lock(print_mutex);
+                std::cerr << file.name << ": bad chunk at offset " << chunk.offset
+                          << " (" << chunk.num_bytes << "B)" << std::endl;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::min(num_threads, std::max<size_t>(tasks.size(), 1)); i++) threads.emplace_back(worker);
+    for (auto &thread : threads) thread.join();
+
+    for (auto &file : files) {
+        if (file.fd == -1) continue;
+        close(file.fd);
+        if (!file.loaded) continue;
+        const bool ok = file.num_bad.load() == 0;
+        all_ok &= ok;
+        std::cout << (ok ? "OK   " : "FAIL ") << file.name << " chunks=" << file.chunks.size()
+                  << " bad=" << file.num_bad.load() << " bytes=" << file.num_bytes.load() << std::endl;
+    }
+    return all_ok ? 0 : 1;
+}